@@ -0,0 +1,164 @@
+// Batch analysis of positions on all cores.
+// Usage: analyze <positions> [--threads=N] [search parameters, e.g. --mode=hybrid --loops=N --timeout=MS]
+// Positions are either a record file (see selfplay.cpp), analysed at every ply
+// from the player to move, or a text file of first turns as main reads them:
+//   board_size, color, board_size rows, last action, actions count
+// Prints "<position> <move> <value> <visits> <ms>" per position, in input order.
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+struct Job
+{
+    Grid grid;
+    string label;
+};
+
+
+struct Result
+{
+    Move move;
+    SearchStats stats;
+    double ms;
+};
+
+
+// One deque of jobs per worker: a worker pops its own jobs from the back,
+// and steals from the front of the others once it has run out
+class WorkStealingQueues
+{
+public:
+    WorkStealingQueues(int workers, int jobs): _queues(workers), _mutexes(workers)
+    {
+        for (int job = 0; job < jobs; job++)
+        {
+            _queues[job % workers].push_back(job);
+        }
+    }
+
+    bool pop(int worker, int& job)
+    {
+        {
+            lock_guard<mutex> lock(_mutexes[worker]);
+            if (!_queues[worker].empty())
+            {
+                job = _queues[worker].back();
+                _queues[worker].pop_back();
+                return true;
+            }
+        }
+        for (int i = 1; i < (int)_queues.size(); i++)
+        {
+            int victim = (worker + i) % _queues.size();
+            lock_guard<mutex> lock(_mutexes[victim]);
+            if (!_queues[victim].empty())
+            {
+                job = _queues[victim].front();
+                _queues[victim].pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    vector<deque<int>> _queues;
+    vector<mutex> _mutexes;
+};
+
+
+void LoadRecords(GameRecordReader& reader, vector<Job>& jobs)
+{
+    GameView game;
+    for (int index = 0; reader.next(game); index++)
+    {
+        Grid grid = GameRecord::startGrid(game.header->boardSize);
+        for (int ply = 0; ply < game.moveCount(); ply++)
+        {
+            jobs.push_back({ply % 2 == 0 ? grid : grid.swapped(), to_string(index) + ":" + to_string(ply)});
+            grid.play(game.move(ply));
+        }
+    }
+}
+
+
+void LoadText(istream& in, vector<Job>& jobs)
+{
+    int boardSize;
+    string color;
+    while (in >> boardSize >> color)
+    {
+        in.ignore();
+        Grid grid(boardSize);
+        readTurn(in, grid, color[0]);
+        jobs.push_back({grid, to_string(jobs.size())});
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    Random::Init();
+
+    if (argc < 2)
+    {
+        DBG("usage: analyze <positions> [--threads=N] [--key=value]...");
+        return 1;
+    }
+    SearchConfig config;
+    int threads = max(1u, thread::hardware_concurrency());
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument.compare(0, 10, "--threads=") == 0)
+            threads = max(1, stoi(argument.substr(10)));
+        else if (!config.parse(argument))
+            DBG("unknown argument " << argument);
+    }
+
+    vector<Job> jobs;
+    GameRecordReader reader(argv[1]);
+    GameView game;
+    if (reader.isOpen() && reader.next(game))
+    {
+        reader.rewind();
+        LoadRecords(reader, jobs);
+    }
+    else
+    {
+        ifstream in(argv[1]);
+        LoadText(in, jobs);
+    }
+    DBG(jobs.size() << " positions on " << threads << " threads");
+
+    vector<Result> results(jobs.size());
+    WorkStealingQueues queues(threads, jobs.size());
+    vector<thread> workers;
+    for (int worker = 0; worker < threads; worker++)
+    {
+        workers.emplace_back([&, worker]()
+        {
+            int job;
+            while (queues.pop(worker, job))
+            {
+                chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+                AI ai(jobs[job].grid, config);
+                Move move = ai.play(start + chrono::milliseconds(config.timeout));
+                chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+                results[job] = {move, ai.stats(), elapsed.count()};
+            }
+        });
+    }
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    for (size_t job = 0; job < jobs.size(); job++)
+    {
+        const Result& result = results[job];
+        cout << jobs[job].label << " " << result.move.toString() << " " << result.stats.value << " "
+             << result.stats.visits << " " << result.ms << endl;
+    }
+}
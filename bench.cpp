@@ -0,0 +1,340 @@
+// Search benchmarks on a fixed set of positions.
+// Usage: bench <benchmark> [--positions=N] [--key=value]...
+//   smp        Lazy SMP alpha-beta: time to depth and nodes/s for 1 to --threads threads
+//   ordering   alpha-beta nodes to reach minimaxDepth, generation order against ordering + PVS
+//   isa        kernel variants supported by this CPU: move generation, evaluation, and MCTS loops
+//   halving    MCTS move quality at --loops playouts, UCT against sequential halving at the root,
+//              as the regret of the chosen move against the most visited one of a search with
+//              ORACLE_FACTOR times more playouts
+//   perf       hardware counters per search phase of one turn per position, and their totals
+//              (build with -DPERF_PROFILE)
+//   leaf       MCTS turn latency: the playouts of a timed sequential turn, then batched leaf playouts on 1 to --threads threads
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+// Positions reached by random moves from the start, the same on every run
+vector<Grid> BenchPositions(int count, int plies)
+{
+    Random::Seed(12345);
+    vector<Grid> positions;
+    bufferPossibleMoves_t moves;
+    while ((int)positions.size() < count)
+    {
+        Grid grid = GameRecord::startGrid(8);
+        Player player = ME;
+        for (int ply = 0; ply < plies; ply++)
+        {
+            int count = grid.getAllPossibleMoves(player, moves);
+            if (count == 0)
+            {
+                break;
+            }
+            grid.play(moves[Random::Rand(count)]);
+            player = player == ME ? ENEMY : ME;
+        }
+        positions.push_back(player == ME ? grid : grid.swapped());
+    }
+    Random::Init();
+    return positions;
+}
+
+
+double Milliseconds(const chrono::high_resolution_clock::time_point& start)
+{
+    return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+
+// Time to complete minimaxDepth, with threads doubling up to config.threads
+void BenchSmp(const vector<Grid>& positions, SearchConfig config)
+{
+    int maxThreads = config.threads;
+    config.mode = ALPHABETA;
+    cout << "threads  time-to-depth(ms)  nodes/s  speedup" << endl;
+    double reference = 0.;
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        config.threads = threads;
+        double total = 0.;
+        long long nodes = 0;
+        for (const Grid& position : positions)
+        {
+            AI ai(position, config);
+            chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+            ai.play(start + chrono::hours(1));
+            total += Milliseconds(start);
+            nodes += ai.stats().visits;
+        }
+        if (threads == 1)
+        {
+            reference = total;
+        }
+        cout << threads << "  " << total / positions.size() << "  " << (long long)(nodes / (total / 1000.))
+             << "  " << reference / total << endl;
+    }
+}
+
+
+// Iterative deepening on one thread, as the first Lazy SMP thread does
+long long NodesToDepth(const Grid& position, int depth, bool ordering, int& value)
+{
+    TranspositionTable table((size_t)HASH_SIZE << 20);
+    atomic<bool> stop(false);
+    AlphaBeta alphaBeta(&table, &stop, chrono::high_resolution_clock::now() + chrono::hours(1));
+    alphaBeta.setOrdering(ordering);
+    Grid grid = position;
+    for (int d = 0; d <= depth; d++)
+    {
+        alphaBeta.bestMove(grid, ME, d, value);
+    }
+    return alphaBeta.nodes();
+}
+
+
+void BenchOrdering(const vector<Grid>& positions, const SearchConfig& config)
+{
+    cout << "position  nodes(generation order)  nodes(ordered+PVS)  ratio  values" << endl;
+    long long totalPlain = 0;
+    long long totalOrdered = 0;
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        int plainValue;
+        int orderedValue;
+        long long plain = NodesToDepth(positions[i], config.minimaxDepth, false, plainValue);
+        long long ordered = NodesToDepth(positions[i], config.minimaxDepth, true, orderedValue);
+        totalPlain += plain;
+        totalOrdered += ordered;
+        cout << i << "  " << plain << "  " << ordered << "  " << (double)ordered / plain
+             << "  " << plainValue << "/" << orderedValue << endl;
+    }
+    cout << "total  " << totalPlain << "  " << totalOrdered << "  " << (double)totalOrdered / totalPlain << endl;
+}
+
+
+// Same positions and random seed for every variant, so that the checksums must match
+void BenchIsa(const vector<Grid>& positions, SearchConfig config)
+{
+    const int REPEATS = 20000;
+    config.mode = MCTS;
+    config.loops = config.loops > 0 ? config.loops : 5000;
+    cout << "isa  movegen(ns)  evaluate(ns)  mcts(loops/s)  checksum" << endl;
+    for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+    {
+        if (!SetIsa((Isa)isa))
+        {
+            cout << ISA_NAMES[isa] << "  unsupported" << endl;
+            continue;
+        }
+        long long checksum = 0;
+        bufferPossibleMoves_t moves;
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < REPEATS; i++)
+        {
+            checksum += positions[i % positions.size()].getAllPossibleMoves(i % 2 == 0 ? ME : ENEMY, moves);
+        }
+        double movegen = Milliseconds(start) * 1e6 / REPEATS;
+        start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < REPEATS; i++)
+        {
+            checksum += evaluate(positions[i % positions.size()]);
+        }
+        double evaluation = Milliseconds(start) * 1e6 / REPEATS;
+        Random::Seed(12345);
+        long long loops = 0;
+        start = chrono::high_resolution_clock::now();
+        for (const Grid& position : positions)
+        {
+            AI ai(position, config);
+            checksum += ai.play(start + chrono::hours(1)).pack();
+            loops += ai.stats().visits;
+        }
+        double mcts = loops / (Milliseconds(start) / 1000.);
+        cout << ISA_NAMES[isa] << "  " << movegen << "  " << evaluation << "  " << (long long)mcts << "  " << checksum << endl;
+    }
+    KERNELS = FastestKernels();
+    cout << "picked  movegen " << ISA_NAMES[KERNELS.movegenIsa] << "  evaluate " << ISA_NAMES[KERNELS.evaluateIsa]
+         << "  search " << ISA_NAMES[KERNELS.isa] << endl;
+}
+
+
+const int ORACLE_FACTOR = 20;
+
+
+// Average of every root move in a long UCT search, proven moves counting as 1 or 0.
+// best is the most visited move, whose average is the most reliable.
+map<int, double> OracleValues(const Grid& position, SearchConfig config, int& best)
+{
+    config.rootPolicy = ROOT_UCT;
+    config.loops *= ORACLE_FACTOR;
+    AI ai(position, config);
+    ai.play();
+    map<int, double> values;
+    int bestPlays = -1;
+    for (const RootStat& stat : ai.rootStats())
+    {
+        int plays = stat.proven == ME ? numeric_limits<int>::max() : stat.plays;
+        if (plays > bestPlays)
+        {
+            bestPlays = plays;
+            best = stat.move.pack();
+        }
+        values[stat.move.pack()] = stat.proven != NONE ? (stat.proven == ME ? 1. : 0.)
+            : stat.plays > 0 ? (double)stat.score / stat.plays : 0.;
+    }
+    return values;
+}
+
+
+void BenchHalving(const vector<Grid>& positions, SearchConfig config)
+{
+    config.mode = MCTS;
+    config.loops = config.loops > 0 ? config.loops : 2000;
+    cout << "position  best(oracle)  uct-move  regret  halving-move  regret" << endl;
+    array<double, 2> regrets = {};
+    array<int, 2> agreements = {};
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        int best;
+        map<int, double> values = OracleValues(positions[i], config, best);
+        cout << i << "  " << Move::unpack(best).toString() << " " << values[best];
+        for (RootPolicy policy : {ROOT_UCT, ROOT_HALVING})
+        {
+            config.rootPolicy = policy;
+            AI ai(positions[i], config);
+            Move move = ai.play();
+            double regret = values[best] - values[move.pack()];
+            regrets[policy] += regret;
+            agreements[policy] += move.pack() == best;
+            cout << "  " << move.toString() << "  " << regret;
+        }
+        cout << endl;
+    }
+    for (RootPolicy policy : {ROOT_UCT, ROOT_HALVING})
+    {
+        cout << (policy == ROOT_UCT ? "uct" : "halving") << ": mean regret " << regrets[policy] / positions.size()
+             << ", best move " << agreements[policy] << "/" << positions.size() << endl;
+    }
+}
+
+
+#ifdef PERF_PROFILE
+// One turn of config.mode per position, for the same seed
+void BenchPerf(const vector<Grid>& positions, SearchConfig config)
+{
+    config.loops = config.loops > 0 || config.mode == ALPHABETA ? config.loops : 5000;
+    Random::Seed(12345);
+    PerfProfile total;
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        AI ai(positions[i], config);
+        ai.play(chrono::high_resolution_clock::now() + chrono::milliseconds(config.timeout));
+        cout << "position " << i << endl << ai.perf().toString() << endl;
+        total.add(ai.perf());
+    }
+    cout << "total" << endl << total.toString() << endl;
+    Random::Init();
+}
+#endif
+
+
+// Each row runs, per position, the playouts a sequential search fits in one turn of
+// config.timeout ms, so that a shorter time is the latency gained on that turn
+void BenchLeaf(const vector<Grid>& positions, SearchConfig config)
+{
+    int maxThreads = config.threads;
+    int perChild = max(1, config.leafPlayouts);
+    config.mode = MCTS;
+    config.threads = 1;
+    config.leafPlayouts = 0;
+    vector<int> budgets;
+    for (const Grid& position : positions)
+    {
+        AI ai(position, config);
+        ai.play(chrono::high_resolution_clock::now() + chrono::milliseconds(config.timeout));
+        budgets.push_back(ai.stats().visits);
+    }
+    auto run = [&](int threads, int leafPlayouts)
+    {
+        config.threads = threads;
+        config.leafPlayouts = leafPlayouts;
+        double total = 0.;
+        long long playouts = 0;
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            config.loops = budgets[i];
+            AI ai(positions[i], config);
+            chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+            ai.play(start + chrono::hours(1));
+            total += Milliseconds(start);
+            playouts += ai.stats().visits;
+        }
+        return make_pair(total, playouts);
+    };
+    // The speedup of the threads is against one thread running the same batches,
+    // the playouts one by one only show what batching costs or gains
+    cout << "threads  leafPlayouts  time(ms)  playouts/s  speedup" << endl;
+    double reference = 0.;
+    for (int threads = 0; threads <= maxThreads; threads = max(1, threads * 2))
+    {
+        pair<double, long long> result = threads == 0 ? run(1, 0) : run(threads, perChild);
+        if (threads == 1)
+        {
+            reference = result.first;
+        }
+        cout << max(1, threads) << "  " << config.leafPlayouts << "  " << result.first / positions.size() << "  "
+             << (long long)(result.second / (result.first / 1000.)) << "  ";
+        if (threads == 0)
+        {
+            cout << "-" << endl;
+        }
+        else
+        {
+            cout << reference / result.first << endl;
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    Random::Init();
+
+    if (argc < 2)
+    {
+        DBG("usage: bench smp|ordering|isa|halving|perf|leaf [--positions=N] [--key=value]...");
+        return 1;
+    }
+    string benchmark = argv[1];
+    int count = 8;
+    SearchConfig config;
+    config.minimaxDepth = 5;
+    config.threads = max(1u, thread::hardware_concurrency());
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument.compare(0, 12, "--positions=") == 0)
+            count = stoi(argument.substr(12));
+        else if (!config.parse(argument))
+            DBG("unknown argument " << argument);
+    }
+    vector<Grid> positions = BenchPositions(count, 12);
+
+    if (benchmark == "smp")
+        BenchSmp(positions, config);
+    else if (benchmark == "ordering")
+        BenchOrdering(positions, config);
+    else if (benchmark == "isa")
+        BenchIsa(positions, config);
+    else if (benchmark == "halving")
+        BenchHalving(positions, config);
+#ifdef PERF_PROFILE
+    else if (benchmark == "perf")
+        BenchPerf(positions, config);
+#endif
+    else if (benchmark == "leaf")
+        BenchLeaf(positions, config);
+    else
+        DBG("unknown benchmark " << benchmark);
+}
@@ -1,9 +1,6 @@
 #undef _GLIBCXX_DEBUG                // disable run-time bound checking, etc
 #pragma GCC optimize("Ofast,inline")
-#pragma GCC target("bmi,bmi2,lzcnt,popcnt")
-#pragma GCC target("movbe")
-#pragma GCC target("aes,pclmul,rdrnd")
-#pragma GCC target("avx,avx2,f16c,fma,sse3,ssse3,sse4.1,sse4.2")
+// No global target: the hot kernels are compiled per instruction set, see Kernels
 
 
 #include <iostream>
@@ -12,7 +9,35 @@
 #include <array>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <new>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cstring>
+#include <climits>
 #include <math.h>
+#ifdef PERF_PROFILE
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 using namespace std;
 
@@ -20,37 +45,223 @@ using namespace std;
 
 const int MY_INFINITY = 9999999;
 const int MAX_NEIGHBOURS = 4;
+const int MAX_GRID_SIZE = 8;
 const int MAX_GRID_CELLS = 64;
 const int MAX_POSSIBLE_MOVES = 112;
 const int MAX_MINIMAX_DEPTH = 3;
+const int WIN_SCORE = 1000;
+const int HYBRID_DEPTH = 3;
+const int HYBRID_PLAYOUT_DEPTH = 1;
+const int HYBRID_MAX_MOVES = 16;
 const int TIMEOUT_START = 1000;
 const int TIMEOUT = 150;
 const double EXPLORATION = 100.;
+#ifdef MCTS_LOOPS_LIMIT
+const int MCTS_LOOPS = MCTS_LOOPS_LIMIT;
+#else
+const int MCTS_LOOPS = 0; // search until the timeout
+#endif
+const int SEARCH_THREADS = 1;
+const int MAX_SEARCH_PLY = 64;
+const int TABLEBASE_PLAYOUT_MOVES = 12; // playouts only look up positions with few moves left
+const int MERGE_MARGIN = 15; // ms kept to merge distributed results before the deadline
+const int HASH_SIZE = 16; // MB
+const int MAX_HASH_SIZE = 1024; // MB, larger tables may not be allocated
+const double PRIOR_WEIGHT = 10.;
+const bool PRIOR_PLAYOUTS = false;
+const int PRIOR_FEATURES = 8;
+const size_t TREE_MEMORY_LIMIT = 256 << 20; // bytes per game, shared by the searches of a server
+const int TRACE_DEPTH = 2;          // tree levels dumped per turn
+const int TRACE_QUEUE = 16;         // snapshots waiting for the trace thread
+const int STATS_CACHE_SIZE = 16;    // MB of a new statistics cache file
+const int STATS_CACHE_DEPTH = 2;    // tree levels read from and saved to the statistics cache
+const int STATS_CACHE_MIN_PLAYS = 8;
+const double STATS_CACHE_CONFIDENCE = 32.;  // visits giving half the weight to the cached average
+const double STATS_PRIOR_SCALE = 4.;        // prior multiplied by exp(scale * (average - 0.5)) at full weight
+const float PLAYOUT_TEMPERATURE = 0.1f;     // Gibbs sampling of the MAST averages
+const float PLAYOUT_EPSILON = 0.f;          // epsilon-greedy instead of Gibbs sampling if > 0
+const float PLAYOUT_DECAY = 0.5f;           // MAST statistics kept from one turn to the next
+const float NST_MIN_VISITS = 4.f;           // replies seen less often only use MAST
+const uint64_t SEED = 0;                    // random seed of each search, 0 to keep the thread stream
+const int LEAF_PLAYOUTS = 0;                // playouts of each new child in one batch, 0 for one playout per loop
 
 
+// Filled once on first use, then read-only: shared by all the games of a server process
 double MyLog(unsigned int value)
 {
-    static array<double, 1000000> cache = {0.};
-    if (cache[value] == 0.)
+    static const vector<double> cache = []()
     {
-        cache[value] = log(value);
-    }
+        vector<double> table(1000000);
+        for (unsigned int i = 0; i < table.size(); i++)
+        {
+            table[i] = log(i);
+        }
+        return table;
+    }();
     return cache[value];
 }
 
 
+// Bodies inlined in each instruction set variant of the hot kernels, see Kernels
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KERNEL_INLINE __attribute__((always_inline)) inline
+// Repeating the optimize pragma lets gcc inline the default target helpers into the variants
+#define TARGET_AVX2 __attribute__((target("avx2,fma,bmi,bmi2,popcnt,lzcnt"), optimize("Ofast,inline")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq,avx2,fma,bmi,bmi2,popcnt,lzcnt"), optimize("Ofast,inline")))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+
+// Engine random numbers: every thread draws from its own xoshiro256** stream, derived
+// from a process seed and the order in which threads first draw. Seed restarts the
+// stream of the calling thread, so that a single threaded search with a fixed number
+// of loops is reproducible. Fill draws in batches from eight xoshiro128++ lanes that
+// the compiler vectorizes.
 class Random
 {
 public:
+    // Seed of the threads drawing for the first time from now on
     static void Init()
     {
-        srand(time(nullptr));
+        BaseSeed() = (uint64_t)chrono::high_resolution_clock::now().time_since_epoch().count();
+        state().seed(BaseSeed(), Streams()++);
+    }
+
+    static void Seed(uint64_t seed)
+    {
+        state().seed(seed, 0);
     }
 
-    // Return a random number in [0, max[
+    // Return a random number in [0, max[, max > 0
     static int Rand(int max)
     {
-        return rand() % max;
+        return Bounded(Bits(), max);
+    }
+
+    static uint32_t Bits()
+    {
+        return state().next() >> 32;
+    }
+
+    // In [0, 1[
+    static float Uniform()
+    {
+        return (state().next() >> 40) * (1.f / (1 << 24));
+    }
+
+    // Lemire's multiply-shift of a 32 bits draw to [0, max[. The modulo only runs, and
+    // the draw is only rejected, in the rare cases where the result would be biased.
+    static int Bounded(uint32_t draw, int max)
+    {
+        uint64_t product = (uint64_t)draw * (uint32_t)max;
+        if ((uint32_t)product < (uint32_t)max)
+        {
+            uint32_t threshold = -(uint32_t)max % (uint32_t)max;
+            while ((uint32_t)product < threshold)
+            {
+                product = (uint64_t)Bits() * (uint32_t)max;
+            }
+        }
+        return product >> 32;
+    }
+
+    // count 32 bits draws, count being a multiple of BATCH
+    KERNEL_INLINE static void Fill(uint32_t* draws, int count)
+    {
+        Lanes& lanes = state().lanes;
+        for (int i = 0; i < count; i += BATCH)
+        {
+            for (int lane = 0; lane < BATCH; lane++)
+            {
+                uint32_t sum = lanes[0][lane] + lanes[3][lane];
+                draws[i + lane] = ((sum << 7) | (sum >> 25)) + lanes[0][lane];
+                uint32_t t = lanes[1][lane] << 9;
+                lanes[2][lane] ^= lanes[0][lane];
+                lanes[3][lane] ^= lanes[1][lane];
+                lanes[1][lane] ^= lanes[2][lane];
+                lanes[0][lane] ^= lanes[3][lane];
+                lanes[2][lane] ^= t;
+                lanes[3][lane] = (lanes[3][lane] << 11) | (lanes[3][lane] >> 21);
+            }
+        }
+    }
+
+    static const int BATCH = 8;
+
+private:
+    typedef array<array<uint32_t, BATCH>, 4> Lanes;     // state word, then lane
+
+    struct State
+    {
+        array<uint64_t, 4> words;
+        Lanes lanes;
+        bool seeded = false;
+
+        void seed(uint64_t seed, uint64_t stream)
+        {
+            uint64_t mix = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+            for (uint64_t& word : words)
+            {
+                word = splitMix(mix);
+            }
+            for (array<uint32_t, BATCH>& laneWords : lanes)
+            {
+                for (uint32_t& word : laneWords)
+                {
+                    word = (uint32_t)(splitMix(mix) >> 32);
+                }
+            }
+            seeded = true;
+        }
+
+        uint64_t next()
+        {
+            uint64_t result = rotate(words[1] * 5, 7) * 9;
+            uint64_t t = words[1] << 17;
+            words[2] ^= words[0];
+            words[3] ^= words[1];
+            words[1] ^= words[2];
+            words[0] ^= words[3];
+            words[2] ^= t;
+            words[3] = rotate(words[3], 45);
+            return result;
+        }
+
+        static uint64_t rotate(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t splitMix(uint64_t& mix)
+        {
+            uint64_t z = (mix += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+    };
+
+    static State& state()
+    {
+        static thread_local State current;
+        if (!current.seeded)
+        {
+            current.seed(BaseSeed(), Streams()++);
+        }
+        return current;
+    }
+
+    static uint64_t& BaseSeed()
+    {
+        static uint64_t seed = 0x5EED;
+        return seed;
+    }
+
+    static atomic<uint64_t>& Streams()
+    {
+        static atomic<uint64_t> streams(0);
+        return streams;
     }
 };
 
@@ -63,6 +274,27 @@ enum Player
 };
 
 
+enum SearchMode
+{
+    MCTS,       // Monte Carlo Tree Search with random playouts
+    ALPHABETA,  // Fixed depth alpha-beta on the shared evaluation
+    HYBRID      // MCTS with shallow alpha-beta checks for forced wins at leaves and in playouts
+};
+
+enum PlayoutMode
+{
+    PLAYOUT_RANDOM, // uniform, or the move prior with priorPlayouts
+    PLAYOUT_MAST,   // Move-Average Sampling: moves that won the previous playouts
+    PLAYOUT_NST     // N-gram Selection: MAST, and replies that won against the previous move
+};
+
+enum RootPolicy
+{
+    ROOT_UCT,       // the root children are selected by UCT, as the other nodes
+    ROOT_HALVING    // sequential halving: rounds spread over the root moves, dropping the worse half after each
+};
+
+
 struct Position
 {
     int x;
@@ -108,9 +340,112 @@ struct Move
         str += '1' + to.y;
         return str;
     }
+
+    // One byte: origin cell (x + 8*y) on 6 bits, direction on 2 bits
+    uint8_t pack() const
+    {
+        int direction = to.x < from.x ? 0 : to.x > from.x ? 1 : to.y < from.y ? 2 : 3;
+        return (uint8_t)((from.x + 8 * from.y) << 2 | direction);
+    }
+
+    static Move unpack(uint8_t packed)
+    {
+        static const int DX[] = {-1, 1, 0, 0};
+        static const int DY[] = {0, 0, -1, 1};
+        Position from((packed >> 2) % 8, (packed >> 2) / 8);
+        int direction = packed & 3;
+        return Move(from, Position(from.x + DX[direction], from.y + DY[direction]));
+    }
 };
 
 typedef array<Move, MAX_POSSIBLE_MOVES> bufferPossibleMoves_t;
+typedef array<uint64_t, MAX_GRID_CELLS> bufferRegions_t;
+
+
+class Grid;
+class TreeElem;
+class AlphaBeta;
+class AI;
+
+// NST context of the root position, which no move led to: outside the packed moves 0-255
+const int NO_PREVIOUS_MOVE = 256;
+
+// Moves and winner of one playout, kept to update the playout policy once it is over
+struct Playout
+{
+    array<uint16_t, MAX_GRID_CELLS + 1> played;
+    int playedCount;
+    Player winner;
+};
+
+// The hot kernels are compiled once per instruction set from the same inline
+// bodies (the *Kernel methods), and the variants are picked at startup among those
+// the CPU supports, so that one binary runs on any x86-64 and uses AVX-512 when present.
+// The search kernels take the widest instruction set; the short move generation and
+// evaluation, called through the pointer, take the variant measured fastest.
+enum Isa {ISA_SCALAR, ISA_AVX2, ISA_AVX512, ISA_COUNT};
+const char* const ISA_NAMES[ISA_COUNT] = {"scalar", "avx2", "avx512"};
+
+
+struct Kernels
+{
+    Isa isa;            // of bestUct and simulation
+    Isa movegenIsa;
+    Isa evaluateIsa;
+    int (*allPossibleMoves)(const Grid& grid, Player player, bufferPossibleMoves_t& moves);
+    int (*evaluate)(const Grid& grid);
+    TreeElem* (*bestUct)(const TreeElem& treeElem, double exploration, double priorWeight);
+    int (*simulation)(const AI& ai, const TreeElem& leaf, AlphaBeta& alphaBeta, Playout& playout);
+};
+
+// Defined with the variants, after AI
+extern Kernels KERNELS;
+
+
+// Fixed random keys of (cell, player) and of the player to move, for incremental hashing
+class Zobrist
+{
+public:
+    static uint64_t key(const Position& pos, Player player)
+    {
+        return keys()[pos.x + 8 * pos.y][player];
+    }
+
+    // Hash change of player playing move
+    static uint64_t move(const Move& move, Player player)
+    {
+        Player other = player == ME ? ENEMY : ME;
+        return key(move.from, player) ^ key(move.to, player) ^ key(move.to, other) ^ SIDE;
+    }
+
+    static const uint64_t SIDE = 0x9e3779b97f4a7c15ULL;
+
+private:
+    typedef array<array<uint64_t, 3>, MAX_GRID_CELLS> keys_t;
+
+    static const keys_t& keys()
+    {
+        static const keys_t KEYS = []()
+        {
+            // splitmix64 on a fixed seed: the same keys in every process
+            keys_t keys;
+            uint64_t state = 0x2545f4914f6cdd1dULL;
+            for (array<uint64_t, 3>& cell : keys)
+            {
+                cell[NONE] = 0;
+                for (int player = ME; player <= ENEMY; player++)
+                {
+                    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                    cell[player] = z ^ (z >> 31);
+                }
+            }
+            return keys;
+        }();
+        return KEYS;
+    }
+};
 
 
 class Grid
@@ -142,6 +477,19 @@ public:
         _cells[pos.x][pos.y] = player;
     }
 
+    void play(const Move& move)
+    {
+        set(move.to, get(move.from));
+        set(move.from, NONE);
+    }
+
+    void undo(const Move& move)
+    {
+        Player player = get(move.to);
+        set(move.from, player);
+        set(move.to, player == ME ? ENEMY : ME);
+    }
+
     int getPossibleMoves(const Position& pos, bufferNeighbours_t& positions) const
     {
         Player player = get(pos);
@@ -174,6 +522,11 @@ public:
     }
 
     int getAllPossibleMoves(Player player, bufferPossibleMoves_t& moves) const
+    {
+        return KERNELS.allPossibleMoves(*this, player, moves);
+    }
+
+    KERNEL_INLINE int getAllPossibleMovesKernel(Player player, bufferPossibleMoves_t& moves) const
     {
         int count = 0;
         bufferNeighbours_t buffer;
@@ -213,7 +566,7 @@ public:
         }
     }
 
-    string toString()
+    string toString() const
     {
         string str;
         for (int y = _size-1; y >= 0; y--)
@@ -246,393 +599,4396 @@ public:
         return _size;
     }
 
-private:
-    int _size;
-    // array<Player, MAX_GRID_CELLS> _cells;
-    array<array<Player, 8>, 8> _cells;
-};
-
-
-class TreeElem
-{
-public:
-    TreeElem(const Grid& grid, TreeElem* parent, Player player, const Move& move):
-        _grid(grid),
-        _parent(parent),
-        _player(player),
-        _move(move),
-        _score(0),
-        _plays(0)
-    {
-    }
-
-    TreeElem* parent()
+    // Zobrist hash, depending on the player to move
+    uint64_t hash(Player player) const
     {
-        return _parent;
+        uint64_t hash = player == ENEMY ? Zobrist::SIDE : 0;
+        for (int x = 0; x < _size; x++)
+        {
+            for (int y = 0; y < _size; y++)
+            {
+                hash ^= Zobrist::key({x,y}, get(x,y));
+            }
+        }
+        return hash;
     }
 
-    bool isRoot() const
+    // Cells of each player as bits x + 8*y
+    void bitboards(uint64_t& me, uint64_t& enemy) const
     {
-        return _parent == nullptr;
+        me = 0;
+        enemy = 0;
+        for (int x = 0; x < _size; x++)
+        {
+            for (int y = 0; y < _size; y++)
+            {
+                Player cell = get(x,y);
+                me |= (uint64_t)(cell == ME) << (x + 8*y);
+                enemy |= (uint64_t)(cell == ENEMY) << (x + 8*y);
+            }
+        }
     }
 
-    void setRoot()
+    // Cells next to the cells of mask, as bitboards
+    static uint64_t neighbours(uint64_t mask)
     {
-        _parent = nullptr;
+        const uint64_t FILE_A = 0x0101010101010101ULL;
+        return ((mask << 1) & ~FILE_A) | ((mask >> 1) & ~(FILE_A << 7)) | (mask << 8) | (mask >> 8);
     }
 
-    vector<TreeElem*>& getChildren()
-    {
-        return _children;
-    }
-    const vector<TreeElem*>& getChildren() const
+    // Connected groups of pieces: a move stays in its region, so regions are independent games
+    static int regions(uint64_t occupied, bufferRegions_t& regions)
     {
-        return _children;
+        int count = 0;
+        while (occupied != 0)
+        {
+            uint64_t region = occupied & -occupied;
+            uint64_t grown = region;
+            do
+            {
+                region = grown;
+                grown = (region | neighbours(region)) & occupied;
+            }
+            while (grown != region);
+            regions[count++] = region;
+            occupied &= ~region;
+        }
+        return count;
     }
 
-    bool isLeaf() const
+    // Inverse of toString, lines being separated by any character
+    static Grid parse(int size, const string& str)
     {
-        return _children.empty();
+        Grid grid(size);
+        int i = 0;
+        for (char c : str)
+        {
+            if (i == size * size)
+            {
+                break;
+            }
+            if (c == '-' || c == 'X' || c == 'O')
+            {
+                grid.set({i % size, size-1 - i / size}, c == 'X' ? ME : c == 'O' ? ENEMY : NONE);
+                i++;
+            }
+        }
+        return grid;
     }
 
-    const Grid& grid() const
+    // Same grid seen from the other player
+    Grid swapped() const
     {
-        return _grid;
+        Grid grid(_size);
+        for (int x = 0; x < _size; x++)
+        {
+            for (int y = 0; y < _size; y++)
+            {
+                Player cell = get(x,y);
+                grid.set({x,y}, cell == NONE ? NONE : cell == ME ? ENEMY : ME);
+            }
+        }
+        return grid;
     }
 
-    const Player& player() const
-    {
-        return _player;
-    }
+private:
+    int _size;
+    // array<Player, MAX_GRID_CELLS> _cells;
+    array<array<Player, MAX_GRID_SIZE>, MAX_GRID_SIZE> _cells;
+};
 
-    const Move& move() const
-    {
-        return _move;
-    }
 
-    int getAllowedMoves(bufferPossibleMoves_t& buffer) const
+// Grid of a playout, with the legal moves of each player in a sparse set of packed
+// moves. A move only changes the moves from and to its two cells, so they are the
+// only ones updated, and a uniform move is drawn in constant time.
+class RolloutState
+{
+public:
+    KERNEL_INLINE RolloutState(const Grid& grid): _grid(grid), _count({0, 0})
     {
-        return _grid.getAllPossibleMoves(_player, buffer);
+        _owner.fill(NONE);
+        bufferPossibleMoves_t moves;
+        for (Player player : {ME, ENEMY})
+        {
+            int count = grid.getAllPossibleMovesKernel(player, moves);
+            for (int i = 0; i < count; i++)
+            {
+                insert(player, moves[i].pack());
+            }
+        }
     }
 
-    TreeElem* addChild(Move moveToPlay)
+    // Callers may search from it, as long as they restore it
+    Grid& grid()
     {
-        // TODO custom allocator for perf (and fix memory leak)
-        Player nextPlayer = _player == ME ? ENEMY : ME;
-        TreeElem* child = new TreeElem(_grid, this, nextPlayer, moveToPlay);
-        _children.push_back(child);
-        child->_grid.set(moveToPlay.from, NONE);
-        child->_grid.set(moveToPlay.to, _player);
-        return child;
+        return _grid;
     }
 
-    void addScore(int score)
+    int count(Player player) const
     {
-        _score += score;
-        _plays++;
+        return _count[player - ME];
     }
 
-    int score() const
+    // draw: 32 random bits, see Random::Fill
+    Move sample(Player player, uint32_t draw) const
     {
-        return _score;
+        return Move::unpack(_moves[player - ME][Random::Bounded(draw, _count[player - ME])]);
     }
 
-    int plays() const
+    // Same moves as Grid::getAllPossibleMoves, in another order
+    int moves(Player player, bufferPossibleMoves_t& moves) const
     {
-        return _plays;
+        int count = _count[player - ME];
+        for (int i = 0; i < count; i++)
+        {
+            moves[i] = Move::unpack(_moves[player - ME][i]);
+        }
+        return count;
     }
 
-    double computeUct() const
+    KERNEL_INLINE void play(const Move& move)
     {
-        // TODO should we consider the defeat as negative score?
-        //DBG(_score << " " << _plays << " " << _parent->_plays);
-        if (_plays == 0)
-            return INFINITY;
-        else
-            return ((double)_score/(double)_plays) + EXPLORATION * sqrt(MyLog(_parent->_plays)/(double)_plays);
+        _grid.play(move);
+        refresh(move.from);
+        refresh(move.to);
     }
 
-    TreeElem* getChildWithBestUct() const
+private:
+    KERNEL_INLINE void refresh(const Position& cell)
     {
-        double bestUct = -INFINITY;
-        TreeElem* bestChild = nullptr;
-        for (TreeElem* child : _children)
+        static const int DX[] = {-1, 1, 0, 0};
+        static const int DY[] = {0, 0, -1, 1};
+        int size = _grid.getSize();
+        for (int direction = 0; direction < 4; direction++)
         {
-            double uct = child->computeUct();
-            if (uct > bestUct)
+            Position neighbour(cell.x + DX[direction], cell.y + DY[direction]);
+            if (neighbour.x >= 0 && neighbour.x < size && neighbour.y >= 0 && neighbour.y < size)
             {
-                bestUct = uct;
-                bestChild = child;
+                update(cell, neighbour, (cell.x + 8 * cell.y) << 2 | direction);
+                update(neighbour, cell, (neighbour.x + 8 * neighbour.y) << 2 | (direction ^ 1));
             }
         }
-        return bestChild;
     }
 
-    TreeElem* getChildWithBestAverageScore() const
+    KERNEL_INLINE void update(const Position& from, const Position& to, uint8_t packed)
     {
-        double bestScore = -INFINITY;
-        TreeElem* bestChild = nullptr;
-        for (TreeElem* child : _children)
+        Player player = _grid.get(from);
+        Player target = _grid.get(to);
+        Player owner = player != NONE && target != NONE && target != player ? player : NONE;
+        if (_owner[packed] != owner)
         {
-            if ((double)child->_score/(double)child->_plays > bestScore)
+            if (_owner[packed] != NONE)
             {
-                bestScore = (double)child->_score/(double)child->_plays;
-                bestChild = child;
+                erase(_owner[packed], packed);
+            }
+            if (owner != NONE)
+            {
+                insert(owner, packed);
             }
         }
-        return bestChild;
     }
 
-    TreeElem* findMove(const Move& move)
+    KERNEL_INLINE void insert(Player player, uint8_t packed)
     {
-        for (TreeElem* child : _children)
-        {
-            if (child->_move == move)
-            {
-                return child;
-            }
-        }
-        return nullptr;
+        int& count = _count[player - ME];
+        _owner[packed] = player;
+        _index[packed] = count;
+        _moves[player - ME][count++] = packed;
     }
 
-    void killBrothers()
+    KERNEL_INLINE void erase(Player player, uint8_t packed)
     {
-        if (!isRoot())
+        array<uint8_t, MAX_POSSIBLE_MOVES>& moves = _moves[player - ME];
+        uint8_t last = moves[--_count[player - ME]];
+        moves[_index[packed]] = last;
+        _index[last] = _index[packed];
+        _owner[packed] = NONE;
+    }
+
+    Grid _grid;
+    array<int, 2> _count;
+    array<array<uint8_t, MAX_POSSIBLE_MOVES>, 2> _moves;
+    array<Player, 256> _owner;      // player who can play the packed move, NONE if illegal
+    array<uint8_t, 256> _index;     // position of the packed move in the moves of its owner
+};
+
+
+/**
+ * Outcome classes of the regions up to maxCells cells, generated by tablebase.cpp.
+ * A file is a TablebaseHeader, then TablebaseShape[shapeCount] sorted by shape,
+ * then 2 bits per colouring of each shape, four per byte, lowest bits first.
+ * Shapes are region bitboards translated to a1; bit i of a colouring is set
+ * when the i-th cell of the shape, lowest bit first, belongs to ME.
+ */
+const char TABLEBASE_MAGIC[4] = {'C', 'L', 'T', 'B'};
+const uint32_t TABLEBASE_VERSION = 1;
+
+struct TablebaseHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t maxCells;
+    uint32_t shapeCount;
+};
+
+struct TablebaseShape
+{
+    uint64_t shape;
+    uint64_t offset;    // index of the first colouring in the outcomes
+};
+
+
+// Mapped tablebase. The outcome bits tell who wins moving first in a region alone:
+// bit 0 for ME, bit 1 for ENEMY. Only sound rules combine regions: a region won
+// by the second player is worth zero, and a sum of regions all won by the same
+// player whoever starts is won by that player.
+class Tablebase
+{
+public:
+    static const uint8_t ZERO = 0;      // second player wins
+    static const uint8_t LEFT = 1;      // ME wins
+    static const uint8_t RIGHT = 2;     // ENEMY wins
+    static const uint8_t FUZZY = 3;     // first player wins
+    static const uint8_t UNKNOWN = 4;
+
+    Tablebase(const string& path): _data(nullptr), _size(0), _header(nullptr), _shapes(nullptr), _outcomes(nullptr)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            DBG("cannot read " << path);
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(TablebaseHeader))
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                _data = static_cast<const uint8_t*>(data);
+                _size = info.st_size;
+                const TablebaseHeader* header = reinterpret_cast<const TablebaseHeader*>(_data);
+                size_t shapesEnd = sizeof(TablebaseHeader) + (size_t)header->shapeCount * sizeof(TablebaseShape);
+                if (equal(TABLEBASE_MAGIC, TABLEBASE_MAGIC + 4, header->magic) && header->version == TABLEBASE_VERSION
+                    && shapesEnd <= _size)
+                {
+                    _header = header;
+                    _shapes = reinterpret_cast<const TablebaseShape*>(_data + sizeof(TablebaseHeader));
+                    _outcomes = _data + shapesEnd;
+                }
+                else
+                {
+                    DBG("bad tablebase " << path);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    Tablebase(const Tablebase&) = delete;
+
+    ~Tablebase()
+    {
+        if (_data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(_data), _size);
+        }
+    }
+
+    // Tables are mapped once per process and never unmapped. nullptr if path is empty or unreadable.
+    static const Tablebase* shared(const string& path)
+    {
+        static mutex tablesMutex;
+        static map<string, unique_ptr<Tablebase>> tables;
+        if (path.empty())
+        {
+            return nullptr;
+        }
+        lock_guard<mutex> lock(tablesMutex);
+        unique_ptr<Tablebase>& table = tables[path];
+        if (table == nullptr)
+        {
+            table.reset(new Tablebase(path));
+        }
+        return table->isOpen() ? table.get() : nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return _header != nullptr;
+    }
+
+    int maxCells() const
+    {
+        return _header->maxCells;
+    }
+
+    // Translate a region and the cells of ME in it to a1
+    static void normalize(uint64_t& region, uint64_t& me)
+    {
+        int dy = __builtin_ctzll(region) / 8;
+        uint64_t files = region >> (8*dy);
+        files |= files >> 32;
+        files |= files >> 16;
+        files |= files >> 8;
+        int shift = 8*dy + __builtin_ctzll(files & 0xFF);
+        region >>= shift;
+        me >>= shift;
+    }
+
+    static uint32_t colouring(uint64_t shape, uint64_t me)
+    {
+        uint32_t index = 0;
+        for (int i = 0; shape != 0; i++, shape &= shape - 1)
+        {
+            if (me & shape & -shape)
+            {
+                index |= 1u << i;
+            }
+        }
+        return index;
+    }
+
+    // Outcome of a region given the cells of ME in it, UNKNOWN if the region is too large
+    uint8_t outcome(uint64_t region, uint64_t me) const
+    {
+        normalize(region, me);
+        const TablebaseShape* end = _shapes + _header->shapeCount;
+        const TablebaseShape* shape = lower_bound(_shapes, end, region,
+            [](const TablebaseShape& entry, uint64_t key) { return entry.shape < key; });
+        if (shape == end || shape->shape != region)
+        {
+            return UNKNOWN;
+        }
+        uint64_t index = shape->offset + colouring(region, me);
+        if (index / 4 >= _size - (_outcomes - _data))
+        {
+            return UNKNOWN;
+        }
+        return (_outcomes[index / 4] >> (2 * (index % 4))) & 3;
+    }
+
+    // Winner of the grid with player to move, NONE if a region is not in the table or the sum is undecided
+    Player winner(const Grid& grid, Player player) const
+    {
+        uint64_t me, enemy;
+        grid.bitboards(me, enemy);
+        uint64_t occupied = me | enemy;
+        // Regions without a capture are never played again: only flood the others
+        uint64_t live = (me & Grid::neighbours(enemy)) | (enemy & Grid::neighbours(me));
+        int active = 0;
+        uint8_t combined = ZERO;
+        while (live != 0)
+        {
+            uint64_t region = live & -live;
+            uint64_t grown = region;
+            do
+            {
+                region = grown;
+                grown = (region | Grid::neighbours(region)) & occupied;
+            }
+            while (grown != region);
+            live &= ~region;
+            if (__builtin_popcountll(region) > (int)_header->maxCells)
+            {
+                return NONE;
+            }
+            uint8_t regionOutcome = outcome(region, region & me);
+            if (regionOutcome == ZERO)
+            {
+                continue;
+            }
+            if (regionOutcome == UNKNOWN || (active > 0 && (regionOutcome != combined || regionOutcome == FUZZY)))
+            {
+                return NONE;
+            }
+            combined = regionOutcome;
+            active++;
+        }
+        Player other = player == ME ? ENEMY : ME;
+        if (combined == FUZZY || combined == ZERO)
+        {
+            return combined == FUZZY ? player : other;
+        }
+        return combined == LEFT ? ME : ENEMY;
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    const TablebaseHeader* _header;
+    const TablebaseShape* _shapes;
+    const uint8_t* _outcomes;
+};
+
+
+// Exhaustive solver writing the tablebase of every region up to maxCells cells fitting on 8x8
+class TablebaseBuilder
+{
+public:
+    TablebaseBuilder(int maxCells): _maxCells(maxCells)
+    {}
+
+    bool write(const string& path)
+    {
+        vector<uint64_t> shapes = enumerateShapes();
+        vector<TablebaseShape> entries;
+        uint64_t offset = 0;
+        for (uint64_t shape : shapes)
+        {
+            entries.push_back({shape, offset});
+            offset += 1ULL << __builtin_popcountll(shape);
+        }
+        vector<uint8_t> outcomes((offset + 3) / 4, 0);
+        for (const TablebaseShape& entry : entries)
+        {
+            int cells = __builtin_popcountll(entry.shape);
+            for (uint32_t colouring = 0; colouring < (1u << cells); colouring++)
+            {
+                uint64_t me = spread(entry.shape, colouring);
+                uint64_t enemy = entry.shape & ~me;
+                uint8_t outcome = (firstPlayerWins(me, enemy) ? Tablebase::LEFT : 0)
+                    | (firstPlayerWins(enemy, me) ? Tablebase::RIGHT : 0);
+                uint64_t index = entry.offset + colouring;
+                outcomes[index / 4] |= outcome << (2 * (index % 4));
+            }
+        }
+        DBG(shapes.size() << " shapes, " << offset << " regions, " << _solved.size() << " positions solved");
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            DBG("cannot write " << path);
+            return false;
+        }
+        TablebaseHeader header;
+        copy(TABLEBASE_MAGIC, TABLEBASE_MAGIC + 4, header.magic);
+        header.version = TABLEBASE_VERSION;
+        header.maxCells = _maxCells;
+        header.shapeCount = entries.size();
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(entries.data(), sizeof(TablebaseShape), entries.size(), file) == entries.size()
+            && fwrite(outcomes.data(), 1, outcomes.size(), file) == outcomes.size();
+        return fclose(file) == 0 && written;
+    }
+
+private:
+    // Fixed polyominoes up to _maxCells fitting on 8x8, grown cell by cell, sorted
+    vector<uint64_t> enumerateShapes() const
+    {
+        const uint64_t FILE_H = 0x8080808080808080ULL;
+        const uint64_t RANK_8 = 0xFF00000000000000ULL;
+        vector<uint64_t> all;
+        vector<uint64_t> current = {1};
+        for (int cells = 1; cells <= _maxCells && !current.empty(); cells++)
+        {
+            all.insert(all.end(), current.begin(), current.end());
+            vector<uint64_t> next;
+            for (uint64_t shape : current)
+            {
+                // Room for a cell on the a file and the first rank
+                uint64_t shifted = shape;
+                if ((shifted & FILE_H) == 0)
+                    shifted <<= 1;
+                if ((shifted & RANK_8) == 0)
+                    shifted <<= 8;
+                for (uint64_t free = Grid::neighbours(shifted) & ~shifted; free != 0; free &= free - 1)
+                {
+                    uint64_t grown = shifted | (free & -free);
+                    uint64_t unused = 0;
+                    Tablebase::normalize(grown, unused);
+                    next.push_back(grown);
+                }
+            }
+            sort(next.begin(), next.end());
+            next.erase(unique(next.begin(), next.end()), next.end());
+            current.swap(next);
+        }
+        sort(all.begin(), all.end());
+        return all;
+    }
+
+    // Inverse of Tablebase::colouring
+    static uint64_t spread(uint64_t shape, uint32_t colouring)
+    {
+        uint64_t me = 0;
+        for (int i = 0; shape != 0; i++, shape &= shape - 1)
+        {
+            if (colouring & (1u << i))
+            {
+                me |= shape & -shape;
+            }
+        }
+        return me;
+    }
+
+    struct Key
+    {
+        uint64_t mover;
+        uint64_t other;
+
+        bool operator==(const Key& key) const
+        {
+            return mover == key.mover && other == key.other;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return key.mover * 0x9E3779B97F4A7C15ULL ^ key.other;
+        }
+    };
+
+    // Regions without any capture never change, so they are removed before the lookup
+    bool firstPlayerWins(uint64_t mover, uint64_t other)
+    {
+        bufferRegions_t regions;
+        int regionsCount = Grid::regions(mover | other, regions);
+        for (int i = 0; i < regionsCount; i++)
+        {
+            if ((Grid::neighbours(regions[i] & mover) & other) == 0)
+            {
+                mover &= ~regions[i];
+                other &= ~regions[i];
+            }
+        }
+        if (mover == 0)
+        {
+            return false;
+        }
+        uint64_t occupied = mover | other;
+        uint64_t shiftedMover = mover;
+        Tablebase::normalize(occupied, shiftedMover);
+        Key key = {shiftedMover, occupied & ~shiftedMover};
+        auto solved = _solved.find(key);
+        if (solved != _solved.end())
+        {
+            return solved->second;
+        }
+        mover = key.mover;
+        other = key.other;
+        bool wins = false;
+        for (uint64_t pieces = mover; pieces != 0 && !wins; pieces &= pieces - 1)
+        {
+            uint64_t from = pieces & -pieces;
+            for (uint64_t targets = Grid::neighbours(from) & other; targets != 0 && !wins; targets &= targets - 1)
+            {
+                uint64_t to = targets & -targets;
+                wins = !firstPlayerWins(other & ~to, (mover & ~from) | to);
+            }
+        }
+        _solved[key] = wins;
+        return wins;
+    }
+
+    int _maxCells;
+    unordered_map<Key, bool, KeyHash> _solved;
+};
+
+
+typedef array<float, PRIOR_FEATURES> priorWeights_t;
+typedef array<float, MAX_POSSIBLE_MOVES> bufferPriors_t;
+typedef array<bufferPriors_t, PRIOR_FEATURES> bufferFeatures_t;
+
+// Fitted by train.cpp
+const priorWeights_t MOVE_PRIOR_WEIGHTS = {-0.108429f, -0.300125f, 0.146622f, 0.254906f, 0.026267f, -0.311918f, -0.297143f, 0.272474f};
+
+
+// Linear model scoring moves from local features around their two cells.
+// Features are stored feature by feature, so that scoring all the moves of
+// a position is a few multiply-add loops over contiguous arrays.
+class MovePrior
+{
+public:
+    MovePrior(const priorWeights_t& weights): _weights(weights)
+    {}
+
+    // Features of the count first moves, played by player
+    static void features(const Grid& grid, Player player, const bufferPossibleMoves_t& moves, int count, bufferFeatures_t& features)
+    {
+        // Number of pieces of each player around each cell, with a border of one cell
+        array<array<float, 10>, 10> own = {};
+        array<array<float, 10>, 10> opp = {};
+        int size = grid.getSize();
+        for (int x = 0; x < size; x++)
+        {
+            for (int y = 0; y < size; y++)
+            {
+                Player cell = grid.get(x,y);
+                if (cell != NONE)
+                {
+                    array<array<float, 10>, 10>& counts = cell == player ? own : opp;
+                    counts[x][y+1]++;
+                    counts[x+2][y+1]++;
+                    counts[x+1][y]++;
+                    counts[x+1][y+2]++;
+                }
+            }
+        }
+        for (int i = 0; i < count; i++)
+        {
+            const Position& from = moves[i].from;
+            const Position& to = moves[i].to;
+            float fromOpp = opp[from.x+1][from.y+1];
+            float toOpp = opp[to.x+1][to.y+1];
+            float toOwn = own[to.x+1][to.y+1];
+            features[0][i] = fromOpp;                               // targets left behind
+            features[1][i] = own[from.x+1][from.y+1];               // friends left behind
+            features[2][i] = toOpp;                                 // targets after the capture
+            features[3][i] = toOwn - 1;                             // other threats on the captured piece
+            features[4][i] = to.x == 0 || to.y == 0 || to.x == size-1 || to.y == size-1;
+            features[5][i] = toOpp == 0;                            // the piece gets stuck
+            features[6][i] = fromOpp == 1;                          // it was its only target
+            features[7][i] = toOwn == 1;                            // the captured piece had no other target
+        }
+    }
+
+    // Softmax of the move scores
+    void probabilities(const Grid& grid, Player player, const bufferPossibleMoves_t& moves, int count, bufferPriors_t& priors) const
+    {
+        bufferFeatures_t features;
+        MovePrior::features(grid, player, moves, count, features);
+        for (int i = 0; i < count; i++)
+        {
+            priors[i] = 0.f;
+        }
+        for (int f = 0; f < PRIOR_FEATURES; f++)
+        {
+            float weight = _weights[f];
+            const bufferPriors_t& feature = features[f];
+            for (int i = 0; i < count; i++)
+            {
+                priors[i] += weight * feature[i];
+            }
+        }
+        float maxScore = *max_element(priors.begin(), priors.begin() + count);
+        float sum = 0.f;
+        for (int i = 0; i < count; i++)
+        {
+            priors[i] = expf(priors[i] - maxScore);
+            sum += priors[i];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            priors[i] /= sum;
+        }
+    }
+
+    // Random index drawn with the prior probabilities
+    int sample(const Grid& grid, Player player, const bufferPossibleMoves_t& moves, int count) const
+    {
+        bufferPriors_t priors = {};
+        probabilities(grid, player, moves, count, priors);
+        float draw = Random::Uniform();
+        for (int i = 0; i < count - 1; i++)
+        {
+            draw -= priors[i];
+            if (draw < 0.f)
+            {
+                return i;
+            }
+        }
+        return count - 1;
+    }
+
+private:
+    priorWeights_t _weights;
+};
+
+
+// Number of my pieces that can still move minus the enemy ones
+KERNEL_INLINE int evaluateKernel(const Grid& grid)
+{
+    int eval = 0;
+
+    bufferNeighbours_t neighbours;
+
+    for (int y = 0; y < grid.getSize(); y++)
+    {
+        for (int x = 0; x < grid.getSize(); x++)
+        {
+            switch (grid.get(x,y))
+            {
+            case NONE:
+                break;
+            case ME:
+                if (grid.getPossibleMoves({x,y}, neighbours) > 0)
+                {
+                    eval++;
+                }
+                break;
+            case ENEMY:
+                if (grid.getPossibleMoves({x,y}, neighbours) > 0)
+                {
+                    eval--;
+                }
+                break;
+            }
+        }
+    }
+    return eval;
+}
+
+int evaluate(const Grid& grid)
+{
+    return KERNELS.evaluate(grid);
+}
+
+
+// Lock-free table shared by the alpha-beta threads. Each entry stores its key
+// xored with its data: an entry torn by concurrent writers fails verification
+// instead of being misread.
+class TranspositionTable
+{
+public:
+    enum Bound
+    {
+        EXACT,
+        LOWER,  // value >= the true score (fail high)
+        UPPER   // value <= the true score (fail low)
+    };
+
+    struct Entry
+    {
+        int value;
+        int depth;
+        Bound bound;
+        uint8_t move;   // Move::pack of the best move, NO_MOVE if unknown
+    };
+
+    // Move::pack never returns 0 for a legal move: a1 cannot move left
+    static const uint8_t NO_MOVE = 0;
+
+    TranspositionTable(size_t bytes): _slots(1)
+    {
+        bytes = min(bytes, (size_t)MAX_HASH_SIZE << 20);
+        while (_slots * 2 * sizeof(Slot) <= bytes)
+        {
+            _slots *= 2;
+        }
+        _table.reset(new Slot[_slots]);
+        clear();
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < _slots; i++)
+        {
+            _table[i].key.store(0, memory_order_relaxed);
+            _table[i].data.store(0, memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t hash, Entry& entry) const
+    {
+        const Slot& slot = _table[hash & (_slots - 1)];
+        uint64_t key = slot.key.load(memory_order_relaxed);
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        if ((key ^ data) != hash || data == 0)
+        {
+            return false;
+        }
+        entry.value = (int)(data & 0xffff) - 0x8000;
+        entry.depth = (data >> 16) & 0xff;
+        entry.bound = (Bound)((data >> 24) & 3);
+        entry.move = (data >> 32) & 0xff;
+        return true;
+    }
+
+    // Keep the deeper entry of a position, always replace another position
+    void store(uint64_t hash, int value, int depth, Bound bound, uint8_t move)
+    {
+        Slot& slot = _table[hash & (_slots - 1)];
+        uint64_t oldData = slot.data.load(memory_order_relaxed);
+        if ((slot.key.load(memory_order_relaxed) ^ oldData) == hash && (int)((oldData >> 16) & 0xff) > depth)
+        {
+            return;
+        }
+        uint64_t data = (uint64_t)(value + 0x8000) | (uint64_t)depth << 16 | (uint64_t)bound << 24 | (uint64_t)move << 32
+            | 1ULL << 40;   // never 0, so that an empty slot cannot verify
+        slot.key.store(hash ^ data, memory_order_relaxed);
+        slot.data.store(data, memory_order_relaxed);
+    }
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> key;
+        atomic<uint64_t> data;
+    };
+
+    size_t _slots;
+    unique_ptr<Slot[]> _table;
+};
+
+
+// Negamax alpha-beta, used by the ALPHABETA mode and by the HYBRID tactical checks.
+// With a table and a stop flag, it is one thread of the Lazy SMP search:
+// it shares the table with the other threads and gives up once stop is set.
+class AlphaBeta
+{
+public:
+    AlphaBeta(): _table(nullptr), _tablebase(nullptr), _stop(nullptr), _nodes(0), _ordering(true)
+    {
+        clearHeuristics();
+    }
+
+    AlphaBeta(TranspositionTable* table, atomic<bool>* stop, const chrono::high_resolution_clock::time_point& deadline):
+        _table(table),
+        _tablebase(nullptr),
+        _stop(stop),
+        _deadline(deadline),
+        _nodes(0),
+        _ordering(true)
+    {
+        clearHeuristics();
+    }
+
+    // Positions decided by the tablebase are scored as wins or losses without searching further
+    void setTablebase(const Tablebase* tablebase)
+    {
+        _tablebase = tablebase;
+    }
+
+    // Without ordering, moves are searched in generation order and without PVS
+    void setOrdering(bool ordering)
+    {
+        _ordering = ordering;
+    }
+
+    // Score of the grid for the player to move.
+    // A player without moves has lost: +/-WIN_SCORE, shifted to prefer the shortest win.
+    int search(Grid& grid, Player player, int depth, int alpha, int beta)
+    {
+        return search(grid, player, _table != nullptr ? grid.hash(player) : 0, depth, 0, alpha, beta);
+    }
+
+    // Best move for player, each move being searched at depth after it is played.
+    // After ordering, the moves are tried from the index rotation, the first move being kept first.
+    Move bestMove(Grid& grid, Player player, int depth, int& value, int rotation = 0)
+    {
+        bufferPossibleMoves_t possibleMoves;
+        int possibleMovesCount = grid.getAllPossibleMoves(player, possibleMoves);
+        if (_ordering)
+        {
+            array<int, MAX_POSSIBLE_MOVES> scores;
+            scoreMoves(grid, player, hashMove(grid.hash(player)), 0, possibleMoves, possibleMovesCount, scores);
+            for (int i = 0; i < possibleMovesCount; i++)
+            {
+                pickNext(possibleMoves, scores, i, possibleMovesCount);
+            }
+        }
+        if (possibleMovesCount > 2)
+        {
+            rotate(possibleMoves.begin() + 1, possibleMoves.begin() + 1 + rotation % (possibleMovesCount - 1),
+                possibleMoves.begin() + possibleMovesCount);
+        }
+        return bestMove(grid, player, possibleMoves, possibleMovesCount, depth, value);
+    }
+
+    Move bestMove(Grid& grid, Player player, const bufferPossibleMoves_t& possibleMoves, int possibleMovesCount, int depth, int& value)
+    {
+        Player other = player == ME ? ENEMY : ME;
+        uint64_t hash = _table != nullptr ? grid.hash(player) : 0;
+        Move bestMove = possibleMoves[0];
+        int alpha = -MY_INFINITY;
+        for (int i = 0; i < possibleMovesCount && !stopped(); i++)
+        {
+            grid.play(possibleMoves[i]);
+            uint64_t childHash = hash ^ Zobrist::move(possibleMoves[i], player);
+            int eval;
+            if (i == 0 || !_ordering)
+            {
+                eval = -search(grid, other, childHash, depth, 1, -MY_INFINITY, -alpha);
+            }
+            else
+            {
+                eval = -search(grid, other, childHash, depth, 1, -alpha-1, -alpha);
+                if (eval > alpha)
+                {
+                    eval = -search(grid, other, childHash, depth, 1, -MY_INFINITY, -alpha);
+                }
+            }
+            grid.undo(possibleMoves[i]);
+            if (eval > alpha)
+            {
+                alpha = eval;
+                bestMove = possibleMoves[i];
+            }
+        }
+        if (_table != nullptr && !stopped() && possibleMovesCount > 0)
+        {
+            _table->store(hash, alpha, depth + 1, TranspositionTable::EXACT, bestMove.pack());
+        }
+        value = alpha;
+        return bestMove;
+    }
+
+    // Winner if one side is forced to win within depth plies, NONE otherwise
+    Player forcedWinner(Grid& grid, Player player, int depth)
+    {
+        int eval = search(grid, player, depth, -WIN_SCORE, WIN_SCORE);
+        if (eval >= WIN_SCORE)
+            return player;
+        else if (eval <= -WIN_SCORE)
+            return player == ME ? ENEMY : ME;
+        else
+            return NONE;
+    }
+
+    bool stopped() const
+    {
+        return _stop != nullptr && _stop->load(memory_order_relaxed);
+    }
+
+    long long nodes() const
+    {
+        return _nodes;
+    }
+
+private:
+    int search(Grid& grid, Player player, uint64_t hash, int depth, int ply, int alpha, int beta)
+    {
+        if ((++_nodes & 1023) == 0 && _stop != nullptr && chrono::high_resolution_clock::now() >= _deadline)
+        {
+            _stop->store(true, memory_order_relaxed);
+        }
+        if (stopped())
+        {
+            return 0;
+        }
+        int alphaOrigin = alpha;
+        TranspositionTable::Entry entry;
+        bool found = _table != nullptr && _table->probe(hash, entry);
+        uint8_t hashMove = found ? entry.move : TranspositionTable::NO_MOVE;
+        if (found && entry.depth >= depth)
+        {
+            if (entry.bound == TranspositionTable::EXACT
+                || (entry.bound == TranspositionTable::LOWER && entry.value >= beta)
+                || (entry.bound == TranspositionTable::UPPER && entry.value <= alpha))
+            {
+                return entry.value;
+            }
+        }
+
+        bufferPossibleMoves_t possibleMoves;
+        int possibleMovesCount = grid.getAllPossibleMoves(player, possibleMoves);
+        if (possibleMovesCount == 0)
+        {
+            return -WIN_SCORE - depth;
+        }
+        if (_tablebase != nullptr)
+        {
+            Player winner = _tablebase->winner(grid, player);
+            if (winner != NONE)
+            {
+                return winner == player ? WIN_SCORE : -WIN_SCORE;
+            }
+        }
+        if (depth == 0)
+        {
+            return player == ME ? evaluate(grid) : -evaluate(grid);
+        }
+        Player other = player == ME ? ENEMY : ME;
+        array<int, MAX_POSSIBLE_MOVES> scores;
+        if (_ordering)
+        {
+            scoreMoves(grid, player, hashMove, ply, possibleMoves, possibleMovesCount, scores);
+        }
+        int bestEval = -MY_INFINITY;
+        int bestIndex = 0;
+        for (int i = 0; i < possibleMovesCount; i++)
+        {
+            if (_ordering)
+            {
+                pickNext(possibleMoves, scores, i, possibleMovesCount);
+            }
+            grid.play(possibleMoves[i]);
+            uint64_t childHash = hash ^ Zobrist::move(possibleMoves[i], player);
+            int eval;
+            if (i == 0 || !_ordering)
+            {
+                eval = -search(grid, other, childHash, depth-1, ply+1, -beta, -alpha);
+            }
+            else
+            {
+                // PVS: prove that the move is not better than the first one with a null window
+                eval = -search(grid, other, childHash, depth-1, ply+1, -alpha-1, -alpha);
+                if (eval > alpha && eval < beta)
+                {
+                    eval = -search(grid, other, childHash, depth-1, ply+1, -beta, -alpha);
+                }
+            }
+            grid.undo(possibleMoves[i]);
+            if (eval > bestEval)
+            {
+                bestEval = eval;
+                bestIndex = i;
+            }
+            alpha = max(alpha, eval);
+            if (beta <= alpha)
+            {
+                if (_ordering)
+                {
+                    addCutoff(player, possibleMoves[i].pack(), depth, ply);
+                }
+                break;
+            }
+        }
+        if (_table != nullptr && !stopped())
+        {
+            TranspositionTable::Bound bound = bestEval <= alphaOrigin ? TranspositionTable::UPPER
+                : bestEval >= beta ? TranspositionTable::LOWER : TranspositionTable::EXACT;
+            _table->store(hash, bestEval, depth, bound, possibleMoves[bestIndex].pack());
+        }
+        return bestEval;
+    }
+
+    uint8_t hashMove(uint64_t hash) const
+    {
+        TranspositionTable::Entry entry;
+        if (_table != nullptr && _table->probe(hash, entry))
+        {
+            return entry.move;
+        }
+        return TranspositionTable::NO_MOVE;
+    }
+
+    void clearHeuristics()
+    {
+        for (array<uint8_t, 2>& killers : _killers)
+        {
+            killers.fill(TranspositionTable::NO_MOVE);
+        }
+        for (array<int, 256>& history : _history)
+        {
+            history.fill(0);
+        }
+    }
+
+    // Staged ordering: hash move, then killers of the ply, then history with a static tie-break
+    void scoreMoves(const Grid& grid, Player player, uint8_t hashMove, int ply,
+        const bufferPossibleMoves_t& moves, int count, array<int, MAX_POSSIBLE_MOVES>& scores) const
+    {
+        const array<uint8_t, 2>& killers = _killers[min(ply, MAX_SEARCH_PLY - 1)];
+        for (int i = 0; i < count; i++)
+        {
+            uint8_t packed = moves[i].pack();
+            if (packed == hashMove)
+                scores[i] = 1 << 30;
+            else if (packed == killers[0])
+                scores[i] = (1 << 29) + 1;
+            else if (packed == killers[1])
+                scores[i] = 1 << 29;
+            else
+                scores[i] = _history[player][packed] * 16 + staticScore(grid, player, moves[i]);
+        }
+    }
+
+    // Opponent moves removed by the capture: the captured piece's targets, and the
+    // opponents next to the origin that lose their target, minus the new threats
+    static int staticScore(const Grid& grid, Player player, const Move& move)
+    {
+        Player other = player == ME ? ENEMY : ME;
+        return countNeighbours(grid, move.to, player) + countNeighbours(grid, move.from, other) - 1
+            - countNeighbours(grid, move.to, other);
+    }
+
+    static int countNeighbours(const Grid& grid, const Position& pos, Player player)
+    {
+        int size = grid.getSize();
+        return (pos.x > 0 && grid.get(pos.x-1, pos.y) == player) + (pos.x < size-1 && grid.get(pos.x+1, pos.y) == player)
+            + (pos.y > 0 && grid.get(pos.x, pos.y-1) == player) + (pos.y < size-1 && grid.get(pos.x, pos.y+1) == player);
+    }
+
+    // Swap the best scored of the remaining moves to index
+    static void pickNext(bufferPossibleMoves_t& moves, array<int, MAX_POSSIBLE_MOVES>& scores, int index, int count)
+    {
+        int best = index;
+        for (int i = index + 1; i < count; i++)
+        {
+            if (scores[i] > scores[best])
+            {
+                best = i;
+            }
+        }
+        swap(moves[index], moves[best]);
+        swap(scores[index], scores[best]);
+    }
+
+    void addCutoff(Player player, uint8_t move, int depth, int ply)
+    {
+        array<uint8_t, 2>& killers = _killers[min(ply, MAX_SEARCH_PLY - 1)];
+        if (killers[0] != move)
+        {
+            killers[1] = killers[0];
+            killers[0] = move;
+        }
+        int& history = _history[player][move];
+        history += depth * depth;
+        if (history > (1 << 20))
+        {
+            for (array<int, 256>& playerHistory : _history)
+            {
+                for (int& value : playerHistory)
+                {
+                    value /= 2;
+                }
+            }
+        }
+    }
+
+    TranspositionTable* _table;
+    const Tablebase* _tablebase;
+    atomic<bool>* _stop;
+    chrono::high_resolution_clock::time_point _deadline;
+    long long _nodes;
+    bool _ordering;
+    array<array<uint8_t, 2>, MAX_SEARCH_PLY> _killers;
+    array<array<int, 256>, 3> _history;
+};
+
+
+// Fixed capacity pool: objects are allocated by chunks on demand, then recycled through a free list
+template <typename T>
+class ObjectPool
+{
+public:
+    ObjectPool(int capacity): _capacity(capacity), _allocated(0)
+    {}
+
+    ObjectPool(const ObjectPool&) = delete;
+
+    // Objects still alive are not destroyed, only their memory is released
+    ~ObjectPool()
+    {
+        for (T* chunk : _chunks)
+        {
+            ::operator delete(chunk);
+        }
+    }
+
+    // Does not free anything when lowered, only stops further allocations
+    void setCapacity(int capacity)
+    {
+        _capacity = capacity;
+    }
+
+    int capacity() const
+    {
+        return _capacity;
+    }
+
+    int used() const
+    {
+        return _allocated - (int)_free.size();
+    }
+
+    int available() const
+    {
+        return _capacity - used();
+    }
+
+    // Return nullptr when the pool is full
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        if (_free.empty())
+        {
+            if (_allocated >= _capacity)
+            {
+                return nullptr;
+            }
+            int count = min(CHUNK_SIZE, _capacity - _allocated);
+            T* chunk = static_cast<T*>(::operator new(sizeof(T) * count));
+            _chunks.push_back(chunk);
+            for (int i = count - 1; i >= 0; i--)
+            {
+                _free.push_back(chunk + i);
+            }
+            _allocated += count;
+        }
+        T* object = _free.back();
+        _free.pop_back();
+        return new (object) T(forward<Args>(args)...);
+    }
+
+    void destroy(T* object)
+    {
+        object->~T();
+        _free.push_back(object);
+    }
+
+    // Give the memory back once every object is destroyed
+    void release()
+    {
+        if (used() > 0)
+        {
+            return;
+        }
+        for (T* chunk : _chunks)
+        {
+            ::operator delete(chunk);
+        }
+        _chunks.clear();
+        vector<T*>().swap(_free);
+        _allocated = 0;
+    }
+
+private:
+    static const int CHUNK_SIZE = 4096;
+
+    int _capacity;
+    int _allocated;
+    vector<T*> _chunks;
+    vector<T*> _free;
+};
+
+
+class TreeElem
+{
+public:
+    TreeElem(const Grid& grid, TreeElem* parent, Player player, const Move& move):
+        _grid(grid),
+        _parent(parent),
+        _player(player),
+        _move(move),
+        _score(0),
+        _plays(0),
+        _prior(0.f),
+        _proven(NONE)
+    {
+    }
+
+    TreeElem* parent()
+    {
+        return _parent;
+    }
+
+    const TreeElem* parent() const
+    {
+        return _parent;
+    }
+
+    bool isRoot() const
+    {
+        return _parent == nullptr;
+    }
+
+    void setRoot()
+    {
+        _parent = nullptr;
+    }
+
+    vector<TreeElem*>& getChildren()
+    {
+        return _children;
+    }
+    const vector<TreeElem*>& getChildren() const
+    {
+        return _children;
+    }
+
+    bool isLeaf() const
+    {
+        return _children.empty();
+    }
+
+    const Grid& grid() const
+    {
+        return _grid;
+    }
+
+    const Player& player() const
+    {
+        return _player;
+    }
+
+    const Move& move() const
+    {
+        return _move;
+    }
+
+    int getAllowedMoves(bufferPossibleMoves_t& buffer) const
+    {
+        return _grid.getAllPossibleMoves(_player, buffer);
+    }
+
+    // Before adding count children, so that they take no more memory than counted in AI::NODE_BYTES
+    void reserveChildren(int count)
+    {
+        _children.reserve(count);
+    }
+
+    // The pool must have room for the child
+    TreeElem* addChild(ObjectPool<TreeElem>& pool, Move moveToPlay)
+    {
+        Player nextPlayer = _player == ME ? ENEMY : ME;
+        TreeElem* child = pool.create(_grid, this, nextPlayer, moveToPlay);
+        _children.push_back(child);
+        child->_grid.play(moveToPlay);
+        return child;
+    }
+
+    void addScore(int score)
+    {
+        _score += score;
+        _plays++;
+    }
+
+    int score() const
+    {
+        return _score;
+    }
+
+    int plays() const
+    {
+        return _plays;
+    }
+
+    // Probability given by the move prior, among the children of the parent
+    void setPrior(float prior)
+    {
+        _prior = prior;
+    }
+
+    float prior() const
+    {
+        return _prior;
+    }
+
+    // MCTS-Solver: winner of this node when it is known for sure, NONE otherwise
+    Player proven() const
+    {
+        return _proven;
+    }
+
+    bool isSolved() const
+    {
+        return _proven != NONE;
+    }
+
+    void setProven(Player winner)
+    {
+        _proven = winner;
+    }
+
+    // Winner deduced from the children: the player to move wins if one of
+    // its moves is a proven win, and loses if all of them are proven losses
+    Player provenFromChildren() const
+    {
+        bool allLost = !_children.empty();
+        for (TreeElem* child : _children)
+        {
+            if (child->_proven == _player)
+            {
+                return _player;
+            }
+            if (child->_proven == NONE)
+            {
+                allLost = false;
+            }
+        }
+        return allLost ? (_player == ME ? ENEMY : ME) : NONE;
+    }
+
+    double computeUct(double exploration, double priorWeight) const
+    {
+        // TODO should we consider the defeat as negative score?
+        //DBG(_score << " " << _plays << " " << _parent->_plays);
+        // Unvisited children first, the most likely according to the prior first,
+        // then a progressive bias toward likely moves that fades with the visits
+        if (_plays == 0)
+            return MY_INFINITY + _prior;
+        else
+            return ((double)_score/(double)_plays) + exploration * sqrt(MyLog(_parent->_plays)/(double)_plays)
+                + priorWeight * _prior / (double)(_plays + 1);
+    }
+
+    // Solved children are skipped: nullptr if all of them are solved
+    TreeElem* getChildWithBestUct(double exploration, double priorWeight) const
+    {
+        return KERNELS.bestUct(*this, exploration, priorWeight);
+    }
+
+    KERNEL_INLINE TreeElem* getChildWithBestUctKernel(double exploration, double priorWeight) const
+    {
+        double bestUct = -INFINITY;
+        TreeElem* bestChild = nullptr;
+        for (TreeElem* child : _children)
+        {
+            if (child->isSolved())
+            {
+                continue;
+            }
+            double uct = child->computeUct(exploration, priorWeight);
+            if (uct > bestUct)
+            {
+                bestUct = uct;
+                bestChild = child;
+            }
+        }
+        return bestChild;
+    }
+
+    // A proven win first, and a proven loss only when every move loses
+    TreeElem* getChildWithBestAverageScore() const
+    {
+        double bestScore = -INFINITY;
+        TreeElem* bestChild = nullptr;
+        for (TreeElem* child : _children)
+        {
+            if (child->_proven == _player)
+            {
+                return child;
+            }
+        }
+        for (TreeElem* child : _children)
+        {
+            if (child->isSolved())
+            {
+                continue;
+            }
+            if ((double)child->_score/(double)child->_plays > bestScore)
+            {
+                bestScore = (double)child->_score/(double)child->_plays;
+                bestChild = child;
+            }
+        }
+        if (bestChild == nullptr && !_children.empty())
+        {
+            // All lost: resist as long as the search did
+            bestChild = *max_element(_children.begin(), _children.end(),
+                [](const TreeElem* a, const TreeElem* b) { return a->_plays < b->_plays; });
+        }
+        return bestChild;
+    }
+
+    TreeElem* findMove(const Move& move)
+    {
+        for (TreeElem* child : _children)
+        {
+            if (child->_move == move)
+            {
+                return child;
+            }
+        }
+        return nullptr;
+    }
+
+    // Give the subtree below this node back to the pool.
+    // Its stats were already backpropagated, so they stay summarized in this node.
+    void clearChildren(ObjectPool<TreeElem>& pool)
+    {
+        for (TreeElem* child : _children)
+        {
+            child->clearChildren(pool);
+            pool.destroy(child);
+        }
+        vector<TreeElem*>().swap(_children);
+    }
+
+    void killBrothers(ObjectPool<TreeElem>& pool)
+    {
+        if (!isRoot())
+        {
+            for (TreeElem* brother : _parent->_children)
+            {
+                if (brother != this)
+                {
+                    brother->clearChildren(pool);
+                    pool.destroy(brother);
+                }
+            }
+            _parent->_children.clear();
+            _parent->_children.push_back(this);
+        }
+    }
+
+private:
+    Grid _grid;
+    TreeElem* _parent;
+    vector<TreeElem*> _children;
+    Player _player; // The player that will play at this stage
+    Move _move; // The move that lead to this node
+    int _score;
+    int _plays;
+    float _prior;
+    Player _proven;
+};
+
+
+// Search parameters, defaulting to the constants above.
+// Set at runtime from "key=value" lines of a file or "--key=value" arguments.
+struct SearchConfig
+{
+    SearchConfig(SearchMode imode = MCTS): mode(imode)
+    {}
+
+    // Names of the enum values, in set and get
+    static constexpr const char* MODES[] = {"mcts", "alphabeta", "hybrid"};
+    static constexpr const char* PLAYOUTS[] = {"random", "mast", "nst"};
+    static constexpr const char* ROOT_POLICIES[] = {"uct", "halving"};
+    static constexpr const char* BOOLEANS[] = {"0", "1", "false", "true"};
+
+    // Return false for an unknown key, or a value that does not parse
+    bool set(const string& key, const string& value)
+    {
+        try
+        {
+            return assign(key, value);
+        }
+        catch (const invalid_argument&)
+        {
+            return false;
+        }
+        catch (const out_of_range&)
+        {
+            return false;
+        }
+    }
+
+    // Throws invalid_argument or out_of_range for a bad value
+    bool assign(const string& key, const string& value)
+    {
+        if (key == "mode")
+            mode = (SearchMode)nameIndex(MODES, value);
+        else if (key == "exploration")
+            exploration = real(value, 0., HUGE_VAL);
+        else if (key == "timeout")
+            timeout = integer(value, 0, INT_MAX);
+        else if (key == "timeoutStart")
+            timeoutStart = integer(value, 0, INT_MAX);
+        else if (key == "loops")
+            loops = integer(value, 0, INT_MAX);
+        else if (key == "minimaxDepth")
+            minimaxDepth = integer(value, 0, MAX_SEARCH_PLY - 1);
+        else if (key == "threads")
+            threads = integer(value, 1, INT_MAX);
+        else if (key == "hashSize")
+            hashSize = integer(value, 1, MAX_HASH_SIZE);
+        else if (key == "hybridDepth")
+            hybridDepth = integer(value, 0, MAX_SEARCH_PLY - 1);
+        else if (key == "hybridPlayoutDepth")
+            hybridPlayoutDepth = integer(value, 0, MAX_SEARCH_PLY - 1);
+        else if (key == "hybridMaxMoves")
+            hybridMaxMoves = integer(value, 0, INT_MAX);
+        else if (key == "priorWeight")
+            priorWeight = real(value, 0., HUGE_VAL);
+        else if (key == "priorPlayouts")
+            priorPlayouts = nameIndex(BOOLEANS, value) % 2;
+        else if (key == "memoryLimit")
+            memoryLimit = (size_t)integer(value, 0, INT_MAX) << 20;
+        else if (key == "tablebase")
+            tablebase = value;
+        else if (key == "trace")
+            trace = value;
+        else if (key == "traceDepth")
+            traceDepth = integer(value, 0, INT_MAX);
+        else if (key == "statsCache")
+            statsCache = value;
+        else if (key == "statsCacheSize")
+            statsCacheSize = integer(value, 1, INT_MAX);
+        else if (key == "playoutPolicy")
+            playoutPolicy = (PlayoutMode)nameIndex(PLAYOUTS, value);
+        else if (key == "playoutTemperature")
+            playoutTemperature = real(value, 1e-3, HUGE_VAL);
+        else if (key == "playoutEpsilon")
+            playoutEpsilon = real(value, 0., 1.);
+        else if (key == "playoutDecay")
+            playoutDecay = real(value, 0., 1.);
+        else if (key == "seed")
+            seed = integer(value, 0, LLONG_MAX);
+        else if (key == "leafPlayouts")
+            leafPlayouts = integer(value, 0, INT_MAX);
+        else if (key == "rootPolicy")
+            rootPolicy = (RootPolicy)nameIndex(ROOT_POLICIES, value);
+        else
+            return false;
+        return true;
+    }
+
+    // Same format as set
+    string get(const string& key) const
+    {
+        if (key == "mode")
+            return MODES[mode];
+        else if (key == "exploration")
+            return to_string(exploration);
+        else if (key == "timeout")
+            return to_string(timeout);
+        else if (key == "timeoutStart")
+            return to_string(timeoutStart);
+        else if (key == "loops")
+            return to_string(loops);
+        else if (key == "minimaxDepth")
+            return to_string(minimaxDepth);
+        else if (key == "threads")
+            return to_string(threads);
+        else if (key == "hashSize")
+            return to_string(hashSize);
+        else if (key == "hybridDepth")
+            return to_string(hybridDepth);
+        else if (key == "hybridPlayoutDepth")
+            return to_string(hybridPlayoutDepth);
+        else if (key == "hybridMaxMoves")
+            return to_string(hybridMaxMoves);
+        else if (key == "priorWeight")
+            return to_string(priorWeight);
+        else if (key == "priorPlayouts")
+            return priorPlayouts ? "1" : "0";
+        else if (key == "memoryLimit")
+            return to_string(memoryLimit >> 20);
+        else if (key == "tablebase")
+            return tablebase;
+        else if (key == "trace")
+            return trace;
+        else if (key == "traceDepth")
+            return to_string(traceDepth);
+        else if (key == "statsCache")
+            return statsCache;
+        else if (key == "statsCacheSize")
+            return to_string(statsCacheSize);
+        else if (key == "playoutPolicy")
+            return PLAYOUTS[playoutPolicy];
+        else if (key == "playoutTemperature")
+            return to_string(playoutTemperature);
+        else if (key == "playoutEpsilon")
+            return to_string(playoutEpsilon);
+        else if (key == "playoutDecay")
+            return to_string(playoutDecay);
+        else if (key == "seed")
+            return to_string(seed);
+        else if (key == "leafPlayouts")
+            return to_string(leafPlayouts);
+        else if (key == "rootPolicy")
+            return ROOT_POLICIES[rootPolicy];
+        else
+            return "";
+    }
+
+    static const vector<string>& keys()
+    {
+        static const vector<string> KEYS = {"mode", "exploration", "timeout", "timeoutStart", "loops", "minimaxDepth",
+            "threads", "hashSize", "hybridDepth", "hybridPlayoutDepth", "hybridMaxMoves", "priorWeight", "priorPlayouts", "memoryLimit", "tablebase",
+            "trace", "traceDepth", "statsCache", "statsCacheSize", "playoutPolicy", "playoutTemperature", "playoutEpsilon",
+            "playoutDecay", "seed", "leafPlayouts", "rootPolicy"};
+        return KEYS;
+    }
+
+    template <size_t N>
+    static int nameIndex(const char* const (&names)[N], const string& value)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (value == names[i])
+            {
+                return i;
+            }
+        }
+        throw invalid_argument(value);
+    }
+
+    // The whole value must parse, and be in [low, high]
+    static long long integer(const string& value, long long low, long long high)
+    {
+        size_t end;
+        long long parsed = stoll(value, &end);
+        if (end != value.size())
+        {
+            throw invalid_argument(value);
+        }
+        if (parsed < low || parsed > high)
+        {
+            throw out_of_range(value);
+        }
+        return parsed;
+    }
+
+    static double real(const string& value, double low, double high)
+    {
+        size_t end;
+        double parsed = stod(value, &end);
+        if (end != value.size())
+        {
+            throw invalid_argument(value);
+        }
+        if (!(parsed >= low && parsed <= high))
+        {
+            throw out_of_range(value);
+        }
+        return parsed;
+    }
+
+    // "--key=value" or "key=value"; "--config=path" loads a file.
+    // Return false if the argument is not a search parameter.
+    bool parse(const string& argument)
+    {
+        string option = argument.compare(0, 2, "--") == 0 ? argument.substr(2) : argument;
+        size_t equal = option.find('=');
+        if (equal == string::npos)
+        {
+            return false;
+        }
+        string key = option.substr(0, equal);
+        string value = option.substr(equal + 1);
+        if (key == "config")
+        {
+            ifstream file(value);
+            if (!file)
+            {
+                DBG("cannot read " << value);
+            }
+            load(file);
+            return true;
+        }
+        return set(key, value);
+    }
+
+    // One "key=value" per line, '#' starts a comment
+    void load(istream& in)
+    {
+        string line;
+        while (getline(in, line))
+        {
+            line = line.substr(0, line.find('#'));
+            line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+            if (!line.empty() && !parse(line))
+            {
+                DBG("bad search parameter " << line);
+            }
+        }
+    }
+
+    string toString() const
+    {
+        string str;
+        for (const string& key : keys())
+        {
+            str += key + "=" + get(key) + "\n";
+        }
+        return str;
+    }
+
+    SearchMode mode;
+    double exploration = EXPLORATION;
+    int timeout = TIMEOUT;
+    int timeoutStart = TIMEOUT_START;
+    int loops = MCTS_LOOPS;                     // MCTS loops per turn instead of the timeout, if > 0
+    int minimaxDepth = MAX_MINIMAX_DEPTH;       // deepest alpha-beta iteration
+    int threads = SEARCH_THREADS;               // Lazy SMP threads of the alpha-beta, leaf playout threads of MCTS
+    int hashSize = HASH_SIZE;                   // MB of the alpha-beta transposition table
+    int hybridDepth = HYBRID_DEPTH;
+    int hybridPlayoutDepth = HYBRID_PLAYOUT_DEPTH;
+    int hybridMaxMoves = HYBRID_MAX_MOVES;
+    double priorWeight = PRIOR_WEIGHT;
+    bool priorPlayouts = PRIOR_PLAYOUTS;
+    size_t memoryLimit = TREE_MEMORY_LIMIT;     // bytes of the MCTS tree, set in MB
+    string tablebase;                           // file written by tablebase.cpp, none if empty
+    string trace;                               // JSON lines of the MCTS tree after each turn, none if empty
+    int traceDepth = TRACE_DEPTH;
+    string statsCache;                          // statistics shared by all the games on this file, none if empty
+    int statsCacheSize = STATS_CACHE_SIZE;      // MB, only used to create the file
+    PlayoutMode playoutPolicy = PLAYOUT_RANDOM;
+    float playoutTemperature = PLAYOUT_TEMPERATURE;
+    float playoutEpsilon = PLAYOUT_EPSILON;
+    float playoutDecay = PLAYOUT_DECAY;
+    uint64_t seed = SEED;                       // with loops and a single thread, makes an MCTS search reproducible
+    int leafPlayouts = LEAF_PLAYOUTS;
+    RootPolicy rootPolicy = ROOT_UCT;
+};
+
+
+// Statistics of a root move, merged across processes by the distributed search
+struct RootStat
+{
+    Move move;
+    int plays;
+    int score;
+    Player proven;
+};
+
+
+// Result of the last search, as stored in game records
+struct SearchStats
+{
+    int visits;     // root visits for MCTS, nodes for alpha-beta
+    float value;    // average score of the chosen child for MCTS, evaluation for alpha-beta
+    int depth;      // deepest completed alpha-beta iteration, 0 for MCTS
+};
+
+
+// Node of a tree snapshot, in depth first order
+struct TraceNode
+{
+    uint8_t depth;      // 1 for the root children
+    uint8_t move;       // Move::pack
+    int8_t proven;      // Player
+    int plays;
+    int score;
+    float uct;
+    float prior;
+};
+
+struct TraceSnapshot
+{
+    string game;
+    int turn;
+    int rootPlays;
+    Move chosen;
+    string grid;
+    vector<TraceNode> nodes;
+};
+
+
+// Appends tree snapshots to a file as JSON lines, one per turn of each game:
+//   {"game":"1234-1","turn":1,"plays":10000,"move":"a1b1","grid":"XO../..","nodes":[[depth,"move",plays,score,uct,prior,proven],...]}
+// The search only copies the nodes into a queue slot: formatting and writing happen
+// on a background thread. When the writer falls behind, new snapshots are dropped.
+class TraceWriter
+{
+public:
+    TraceWriter(const string& path): _file(path, ios::app), _slots(TRACE_QUEUE), _head(0), _count(0), _dropped(0), _stopping(false)
+    {
+        if (!_file)
+        {
+            DBG("cannot write " << path);
+            return;
+        }
+        _worker = thread([this]() { work(); });
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+
+    // Write the queued snapshots, then stop
+    ~TraceWriter()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_one();
+        if (_worker.joinable())
+        {
+            _worker.join();
+        }
+        if (_dropped > 0)
+        {
+            DBG(_dropped << " trace snapshots dropped");
+        }
+    }
+
+    // One writer per file for the whole process, so that the games of a server share it.
+    // nullptr if path is empty or cannot be written.
+    static TraceWriter* shared(const string& path)
+    {
+        static mutex writersMutex;
+        static map<string, unique_ptr<TraceWriter>> writers;
+        if (path.empty())
+        {
+            return nullptr;
+        }
+        lock_guard<mutex> lock(writersMutex);
+        unique_ptr<TraceWriter>& writer = writers[path];
+        if (writer == nullptr)
+        {
+            writer.reset(new TraceWriter(path));
+        }
+        return writer->_worker.joinable() ? writer.get() : nullptr;
+    }
+
+    // Distinct for every game of every process writing to a trace: the pid, then a count
+    static string newGame()
+    {
+        static atomic<int> games(0);
+        return to_string(getpid()) + "-" + to_string(++games);
+    }
+
+    // The snapshot is swapped with a free slot, so that slots keep their allocations
+    void push(TraceSnapshot& snapshot)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (_count == (int)_slots.size())
+            {
+                _dropped++;
+                return;
+            }
+            swap(_slots[(_head + _count) % _slots.size()], snapshot);
+            _count++;
+        }
+        _condition.notify_one();
+    }
+
+private:
+    void work()
+    {
+        TraceSnapshot snapshot;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(_mutex);
+                _condition.wait(lock, [this]() { return _stopping || _count > 0; });
+                if (_count == 0)
+                {
+                    return;
+                }
+                swap(snapshot, _slots[_head]);
+                _head = (_head + 1) % _slots.size();
+                _count--;
+            }
+            write(snapshot);
+        }
+    }
+
+    void write(const TraceSnapshot& snapshot)
+    {
+        _file << "{\"game\":\"" << snapshot.game << "\",\"turn\":" << snapshot.turn << ",\"plays\":" << snapshot.rootPlays
+              << ",\"move\":\"" << snapshot.chosen.toString() << "\",\"grid\":\"" << snapshot.grid << "\",\"nodes\":[";
+        for (size_t i = 0; i < snapshot.nodes.size(); i++)
+        {
+            const TraceNode& node = snapshot.nodes[i];
+            _file << (i > 0 ? "," : "") << "[" << (int)node.depth << ",\"" << Move::unpack(node.move).toString() << "\","
+                  << node.plays << "," << node.score << "," << node.uct << "," << node.prior << "," << (int)node.proven << "]";
+        }
+        _file << "]}" << endl;
+    }
+
+    ofstream _file;
+    vector<TraceSnapshot> _slots;
+    int _head;
+    int _count;
+    int _dropped;
+    bool _stopping;
+    mutex _mutex;
+    condition_variable _condition;
+    thread _worker;
+};
+
+
+/**
+ * Visits and wins of positions, accumulated over games in a file mapped shared
+ * by every process using it. A file is a StatsCacheHeader followed by buckets of
+ * four StatsSlot, one cache line each. Slots are claimed with a compare and swap
+ * on their key and only ever incremented, so concurrent processes need no lock.
+ * When a bucket is full, the position is not cached.
+ */
+const char STATS_CACHE_MAGIC[4] = {'C', 'L', 'S', 'C'};
+const uint32_t STATS_CACHE_VERSION = 1;
+
+struct StatsCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t slots;
+};
+
+struct StatsSlot
+{
+    atomic<uint64_t> key;       // Grid::hash, 0 when free
+    atomic<uint32_t> visits;
+    atomic<uint32_t> wins;      // for the player who moved to the position
+};
+
+
+class StatsCache
+{
+public:
+    StatsCache(const string& path, size_t bytes): _data(nullptr), _size(0), _slots(nullptr), _bucketMask(0)
+    {
+        static_assert(sizeof(StatsSlot) == 16 && atomic<uint64_t>::is_always_lock_free, "slots are shared between processes");
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            DBG("cannot open " << path);
+            return;
+        }
+        size_t buckets = 1;
+        while ((buckets * 2) * 4 * sizeof(StatsSlot) <= bytes)
+        {
+            buckets *= 2;
+        }
+        size_t created = sizeof(StatsCacheHeader) + buckets * 4 * sizeof(StatsSlot);
+        struct stat info;
+        // Processes creating the file together write the same header
+        if (fstat(fd, &info) == 0 && (info.st_size != 0 || (ftruncate(fd, created) == 0 && fstat(fd, &info) == 0)))
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                _data = static_cast<uint8_t*>(data);
+                _size = info.st_size;
+                StatsCacheHeader* header = reinterpret_cast<StatsCacheHeader*>(_data);
+                if (header->version == 0)
+                {
+                    copy(STATS_CACHE_MAGIC, STATS_CACHE_MAGIC + 4, header->magic);
+                    header->slots = buckets * 4;
+                    header->version = STATS_CACHE_VERSION;
+                }
+                uint64_t slots = header->slots;
+                if (equal(STATS_CACHE_MAGIC, STATS_CACHE_MAGIC + 4, header->magic) && header->version == STATS_CACHE_VERSION
+                    && slots >= 4 && (slots & (slots - 1)) == 0 && sizeof(StatsCacheHeader) + slots * sizeof(StatsSlot) <= _size)
+                {
+                    _slots = reinterpret_cast<StatsSlot*>(_data + sizeof(StatsCacheHeader));
+                    _bucketMask = slots / 4 - 1;
+                }
+                else
+                {
+                    DBG("bad statistics cache " << path);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    StatsCache(const StatsCache&) = delete;
+
+    ~StatsCache()
+    {
+        if (_data != nullptr)
+        {
+            munmap(_data, _size);
+        }
+    }
+
+    // Caches are mapped once per process. nullptr if path is empty or unusable.
+    static StatsCache* shared(const string& path, size_t bytes)
+    {
+        static mutex cachesMutex;
+        static map<string, unique_ptr<StatsCache>> caches;
+        if (path.empty())
+        {
+            return nullptr;
+        }
+        lock_guard<mutex> lock(cachesMutex);
+        unique_ptr<StatsCache>& cache = caches[path];
+        if (cache == nullptr)
+        {
+            cache.reset(new StatsCache(path, bytes));
+        }
+        return cache->isOpen() ? cache.get() : nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return _slots != nullptr;
+    }
+
+    // Return false if the position is not cached
+    bool probe(uint64_t hash, uint32_t& visits, uint32_t& wins) const
+    {
+        uint64_t key = hash != 0 ? hash : 1;
+        StatsSlot* bucket = _slots + 4 * (key & _bucketMask);
+        for (int i = 0; i < 4; i++)
+        {
+            if (bucket[i].key.load(memory_order_relaxed) == key)
+            {
+                visits = bucket[i].visits.load(memory_order_relaxed);
+                wins = bucket[i].wins.load(memory_order_relaxed);
+                return visits > 0;
+            }
+        }
+        return false;
+    }
+
+    void add(uint64_t hash, uint32_t visits, uint32_t wins)
+    {
+        uint64_t key = hash != 0 ? hash : 1;
+        StatsSlot* bucket = _slots + 4 * (key & _bucketMask);
+        for (int i = 0; i < 4; i++)
+        {
+            uint64_t current = bucket[i].key.load(memory_order_relaxed);
+            if (current == 0 && bucket[i].key.compare_exchange_strong(current, key, memory_order_relaxed))
+            {
+                current = key;
+            }
+            if (current == key)
+            {
+                // Stop counting well before the counters wrap
+                if (bucket[i].visits.load(memory_order_relaxed) < (1u << 30))
+                {
+                    bucket[i].visits.fetch_add(visits, memory_order_relaxed);
+                    bucket[i].wins.fetch_add(wins, memory_order_relaxed);
+                }
+                return;
+            }
+        }
+    }
+
+    // Schedule the write back of the file, other processes already see the updates
+    void sync()
+    {
+        msync(_data, _size, MS_ASYNC);
+    }
+
+private:
+    uint8_t* _data;
+    size_t _size;
+    StatsSlot* _slots;
+    uint64_t _bucketMask;
+};
+
+
+// Win statistics of the moves played in the playouts, learned during the search.
+// MAST keeps one entry per player and packed move, NST one more per player,
+// previous move and reply. Each entry caches its Gibbs weight exp(average / temperature),
+// so that sampling a playout move is a few loads and a draw.
+class PlayoutPolicy
+{
+public:
+    PlayoutPolicy(): _temperature(PLAYOUT_TEMPERATURE), _epsilon(PLAYOUT_EPSILON), _ngrams(false)
+    {}
+
+    // The tables are only allocated for the MAST and NST modes
+    void configure(PlayoutMode mode, float temperature, float epsilon)
+    {
+        _temperature = temperature;
+        _epsilon = epsilon;
+        _ngrams = mode == PLAYOUT_NST;
+        _mast.assign(2 * 256, {0.f, 0.f, weight(0.f, 0.f)});
+        _nst.assign(_ngrams ? 2 * 256 * 256 : 0, {0.f, 0.f, weight(0.f, 0.f)});
+    }
+
+    // Between turns: factor 0 forgets everything, 1 keeps everything
+    void decay(float factor)
+    {
+        for (vector<Stat>* table : {&_mast, &_nst})
+        {
+            for (Stat& stat : *table)
+            {
+                stat.visits *= factor;
+                stat.wins *= factor;
+                stat.weight = weight(stat.visits, stat.wins);
+            }
+        }
+    }
+
+    // previous is the packed move that led to the position, or NO_PREVIOUS_MOVE at the root
+    KERNEL_INLINE int sample(Player player, int previous, const bufferPossibleMoves_t& moves, int count) const
+    {
+        const Stat* mast = &_mast[(player - ME) << 8];
+        const Stat* nst = _ngrams && previous != NO_PREVIOUS_MOVE ? &_nst[((player - ME) << 16) | (previous << 8)] : nullptr;
+        if (_epsilon > 0.f)
+        {
+            if (Random::Uniform() < _epsilon)
+            {
+                return Random::Rand(count);
+            }
+            int best = 0;
+            float bestWeight = -1.f;
+            for (int i = 0; i < count; i++)
+            {
+                float moveWeight = weight(mast, nst, moves[i].pack());
+                if (moveWeight > bestWeight)
+                {
+                    bestWeight = moveWeight;
+                    best = i;
+                }
+            }
+            return best;
+        }
+        array<float, MAX_POSSIBLE_MOVES> weights;
+        float sum = 0.f;
+        for (int i = 0; i < count; i++)
+        {
+            weights[i] = weight(mast, nst, moves[i].pack());
+            sum += weights[i];
+        }
+        float draw = Random::Uniform() * sum;
+        for (int i = 0; i < count - 1; i++)
+        {
+            draw -= weights[i];
+            if (draw < 0.f)
+            {
+                return i;
+            }
+        }
+        return count - 1;
+    }
+
+    KERNEL_INLINE void update(Player player, int previous, uint8_t move, bool won)
+    {
+        add(_mast[((player - ME) << 8) | move], won);
+        if (_ngrams && previous != NO_PREVIOUS_MOVE)
+        {
+            add(_nst[((player - ME) << 16) | (previous << 8) | move], won);
+        }
+    }
+
+    bool enabled() const
+    {
+        return !_mast.empty();
+    }
+
+private:
+    struct Stat
+    {
+        float visits;
+        float wins;
+        float weight;
+    };
+
+    float weight(float visits, float wins) const
+    {
+        return expf((wins + 1.f) / (visits + 2.f) / _temperature);
+    }
+
+    KERNEL_INLINE float weight(const Stat* mast, const Stat* nst, uint8_t move) const
+    {
+        if (nst != nullptr && nst[move].visits >= NST_MIN_VISITS)
+        {
+            // Gibbs weight of the mean of both averages
+            return sqrtf(mast[move].weight * nst[move].weight);
+        }
+        return mast[move].weight;
+    }
+
+    KERNEL_INLINE void add(Stat& stat, bool won)
+    {
+        stat.visits += 1.f;
+        stat.wins += won ? 1.f : 0.f;
+        stat.weight = weight(stat.visits, stat.wins);
+    }
+
+    float _temperature;
+    float _epsilon;
+    bool _ngrams;
+    vector<Stat> _mast;
+    vector<Stat> _nst;
+};
+
+
+#ifdef PERF_PROFILE
+// Profiling build (-DPERF_PROFILE): hardware counters of the search thread around each
+// MCTS phase and each alpha-beta iteration, printed after every turn. Each lap costs a
+// read system call, so that the counts include a small overhead of their own.
+enum PerfEvent {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_EVENTS};
+const char* const PERF_EVENT_NAMES[PERF_EVENTS] = {"cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses"};
+
+typedef array<uint64_t, PERF_EVENTS> perfCounts_t;
+
+
+// Counters of one thread, opened as one group so that they are read together. The events
+// the kernel or the CPU refuse, e.g. in a VM or with perf_event_paranoid > 2, stay at zero.
+class PerfCounters
+{
+public:
+    static PerfCounters& thread()
+    {
+        static thread_local PerfCounters counters;
+        return counters;
+    }
+
+    ~PerfCounters()
+    {
+        for (int fd : _fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    bool available() const
+    {
+        return _leader >= 0;
+    }
+
+    void read(perfCounts_t& counts) const
+    {
+        counts.fill(0);
+        if (_leader < 0)
+        {
+            return;
+        }
+        // nr, then the values in the order the events joined the group
+        array<uint64_t, PERF_EVENTS + 1> values;
+        if (::read(_leader, values.data(), sizeof(values)) <= 0)
+        {
+            return;
+        }
+        for (int i = 0; i < (int)values[0]; i++)
+        {
+            counts[_order[i]] = values[i + 1];
+        }
+    }
+
+private:
+    PerfCounters(): _leader(-1), _members(0)
+    {
+        static const uint64_t CACHE_MISS = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        static const pair<uint32_t, uint64_t> EVENTS[PERF_EVENTS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | CACHE_MISS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | CACHE_MISS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+        _fds.fill(-1);
+        for (int event = 0; event < PERF_EVENTS; event++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = EVENTS[event].first;
+            attr.config = EVENTS[event].second;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = _leader < 0;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0);
+            if (fd < 0)
+            {
+                continue;
+            }
+            _fds[event] = fd;
+            _order[_members++] = event;
+            if (_leader < 0)
+            {
+                _leader = fd;
+            }
+        }
+        if (_leader < 0)
+        {
+            static atomic<bool> warned(false);
+            if (!warned.exchange(true))
+            {
+                DBG("perf counters unavailable: " << strerror(errno));
+            }
+            return;
+        }
+        ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    array<int, PERF_EVENTS> _fds;
+    array<int, PERF_EVENTS> _order;
+    int _leader;
+    int _members;
+};
+
+
+// The MCTS phases, then one slot per alpha-beta iteration depth
+enum PerfSlot {PERF_SELECTION, PERF_EXPANSION, PERF_PROOF, PERF_SIMULATION, PERF_BACKPROPAGATION, PERF_DEPTH,
+    PERF_SLOTS = PERF_DEPTH + MAX_SEARCH_PLY};
+
+// Counts of one turn per slot. The counters are those of the thread running the search:
+// the Lazy SMP helpers and the leaf workers are not counted, a batch of leaf playouts
+// counting the wait for the workers instead.
+class PerfProfile
+{
+public:
+    PerfProfile()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (Total& total : _totals)
+        {
+            total = Total();
+        }
+    }
+
+    // Start counting the next lap on this thread
+    void begin()
+    {
+        PerfCounters::thread().read(_start);
+        _startTime = chrono::high_resolution_clock::now();
+    }
+
+    // Add the counts since begin or the previous lap to slot
+    void lap(int slot)
+    {
+        perfCounts_t now;
+        PerfCounters::thread().read(now);
+        chrono::high_resolution_clock::time_point nowTime = chrono::high_resolution_clock::now();
+        Total& total = _totals[min(slot, PERF_SLOTS - 1)];
+        total.calls++;
+        total.ms += chrono::duration<double, milli>(nowTime - _startTime).count();
+        for (int event = 0; event < PERF_EVENTS; event++)
+        {
+            total.counts[event] += now[event] - _start[event];
+        }
+        _start = now;
+        _startTime = nowTime;
+    }
+
+    void add(const PerfProfile& other)
+    {
+        for (int slot = 0; slot < PERF_SLOTS; slot++)
+        {
+            _totals[slot].calls += other._totals[slot].calls;
+            _totals[slot].ms += other._totals[slot].ms;
+            for (int event = 0; event < PERF_EVENTS; event++)
+            {
+                _totals[slot].counts[event] += other._totals[slot].counts[event];
+            }
+        }
+    }
+
+    // One line per slot used, counts per call
+    string toString() const
+    {
+        static const char* PHASES[PERF_DEPTH] = {"selection", "expansion", "proof", "simulation", "backpropagation"};
+        ostringstream out;
+        out << "phase  calls  ms";
+        for (const char* name : PERF_EVENT_NAMES)
+        {
+            out << "  " << name;
+        }
+        out << "  IPC";
+        if (!PerfCounters::thread().available())
+        {
+            out << "  (counters unavailable)";
+        }
+        for (int slot = 0; slot < PERF_SLOTS; slot++)
+        {
+            const Total& total = _totals[slot];
+            if (total.calls == 0)
+            {
+                continue;
+            }
+            out << endl << (slot < PERF_DEPTH ? PHASES[slot] : "depth-" + to_string(slot - PERF_DEPTH)) << "  " << total.calls << "  " << total.ms;
+            for (uint64_t count : total.counts)
+            {
+                out << "  " << count / total.calls;
+            }
+            out << "  " << (total.counts[PERF_CYCLES] > 0 ? (double)total.counts[PERF_INSTRUCTIONS] / total.counts[PERF_CYCLES] : 0.);
+        }
+        return out.str();
+    }
+
+private:
+    struct Total
+    {
+        long long calls = 0;
+        double ms = 0.;
+        perfCounts_t counts = {};
+    };
+
+    array<Total, PERF_SLOTS> _totals;
+    perfCounts_t _start;
+    chrono::high_resolution_clock::time_point _startTime;
+};
+
+#define PERF_BEGIN(profile) (profile).begin()
+#define PERF_LAP(profile, slot) (profile).lap(slot)
+#else
+#define PERF_BEGIN(profile)
+#define PERF_LAP(profile, slot)
+#endif
+
+
+// Fixed size pool of worker threads consuming a FIFO of tasks
+class ThreadPool
+{
+public:
+    ThreadPool(int threads): _stopping(false)
+    {
+        for (int i = 0; i < threads; i++)
+        {
+            _workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    // Run the remaining tasks, then join the workers
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wakeUp.notify_all();
+        for (thread& worker : _workers)
+        {
+            worker.join();
+        }
+    }
+
+    void push(function<void()> task)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _tasks.push_back(move(task));
+        }
+        _wakeUp.notify_one();
+    }
+
+    // Start workers until there are threads of them
+    void grow(int threads)
+    {
+        lock_guard<mutex> lock(_mutex);
+        while ((int)_workers.size() < threads)
+        {
+            _workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    // One pool for all the searches of the process, as large as the largest of them needs,
+    // so that a server running many games does not start workers for each of them
+    static ThreadPool& shared(int threads)
+    {
+        static ThreadPool pool(0);
+        pool.grow(threads);
+        return pool;
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(_mutex);
+                _wakeUp.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+                if (_tasks.empty())
+                {
+                    return;
+                }
+                task = move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    vector<thread> _workers;
+    deque<function<void()>> _tasks;
+    mutex _mutex;
+    condition_variable _wakeUp;
+    bool _stopping;
+};
+
+
+class AI
+{
+public:
+    AI(const Grid& grid, const SearchConfig& config = SearchConfig()):
+        _grid(grid),
+        _config(config),
+        _pool(nodeCapacity(config.memoryLimit)),
+        _prior(MOVE_PRIOR_WEIGHTS),
+        _tablebase(Tablebase::shared(config.tablebase)),
+        _trace(TraceWriter::shared(config.trace)),
+        _game(_trace != nullptr ? TraceWriter::newGame() : ""),
+        _statsCache(StatsCache::shared(config.statsCache, (size_t)config.statsCacheSize << 20)),
+        _turn(0),
+        _treeRoot(nullptr),
+        _timeout(config.timeoutStart),
+        _stats({0, 0.f, 0}),
+        _rootPart(0),
+        _rootParts(1)
+    {
+        _alphaBeta.setTablebase(_tablebase);
+        if (config.playoutPolicy != PLAYOUT_RANDOM)
+        {
+            _playoutPolicy.configure(config.playoutPolicy, config.playoutTemperature, config.playoutEpsilon);
+        }
+    }
+
+    AI(const AI&) = delete;
+
+    ~AI()
+    {
+        releaseTree();
+    }
+
+    // Tree memory per node: the node, its pointer in the children of its parent,
+    // and its slot in the free list of the pool
+    static const size_t NODE_BYTES = sizeof(TreeElem) + 2 * sizeof(TreeElem*);
+
+    // Budget of the MCTS tree. At least the root and its children fit, whatever the budget.
+    void setMemoryLimit(size_t bytes)
+    {
+        _config.memoryLimit = bytes;
+        _pool.setCapacity(nodeCapacity(bytes));
+    }
+
+    // Free the tree and the memory of its nodes until the next search
+    void releaseMemory()
+    {
+        releaseTree();
+        _pool.release();
+    }
+
+    int treeSize() const
+    {
+        return _pool.used();
+    }
+
+    const SearchStats& stats() const
+    {
+        return _stats;
+    }
+
+    // Only search the root moves whose index modulo parts is part
+    void setRootPart(int part, int parts)
+    {
+        _rootPart = part;
+        _rootParts = parts;
+    }
+
+    // Root children of the last MCTS search
+    vector<RootStat> rootStats() const
+    {
+        vector<RootStat> stats;
+        if (_treeRoot != nullptr)
+        {
+            for (const TreeElem* child : _treeRoot->getChildren())
+            {
+                stats.push_back({child->move(), child->plays(), child->score(), child->proven()});
+            }
+        }
+        return stats;
+    }
+
+    // Add the top levels of the last MCTS tree to the statistics cache.
+    // Called once the move is sent, so that it does not delay the answer.
+    void saveStats()
+    {
+        if (_statsCache != nullptr && _treeRoot != nullptr && _config.mode != ALPHABETA)
+        {
+            saveStats(*_treeRoot, _treeRoot->grid().hash(_treeRoot->player()), 0);
+        }
+    }
+
+    // Fixed number of MCTS loops instead of the timeout, 0 to use the timeout
+    void setLoopsLimit(int loops)
+    {
+        _config.loops = loops;
+    }
+
+    // Return pair<from, to>
+    Move play()
+    {
+        Move pos = play(chrono::high_resolution_clock::now() + chrono::milliseconds(_timeout));
+        // After first turn, timeout is 100 ms
+        _timeout = _config.timeout;
+        return pos;
+    }
+
+    // Search until the given deadline
+    Move play(const chrono::high_resolution_clock::time_point& deadline)
+    {
+#ifdef PERF_PROFILE
+        _perf.clear();
+#endif
+        Move move = _config.mode == ALPHABETA ? playAlphaBeta(deadline) : playMcts(deadline);
+#ifdef PERF_PROFILE
+        DBG(_perf.toString());
+#endif
+        return move;
+    }
+
+#ifdef PERF_PROFILE
+    // Counts of the last turn
+    const PerfProfile& perf() const
+    {
+        return _perf;
+    }
+#endif
+
+private:
+    static int nodeCapacity(size_t bytes)
+    {
+        return max(bytes / NODE_BYTES, (size_t)1 + MAX_POSSIBLE_MOVES);
+    }
+
+    Move playMcts(const chrono::high_resolution_clock::time_point& deadline)
+    {
+        // TODO remove if we want to reuse tree
+        releaseTree();
+        if (_playoutPolicy.enabled() && _turn > 0)
+        {
+            _playoutPolicy.decay(_config.playoutDecay);
+        }
+        if (_config.seed != 0)
+        {
+            // Each turn of a game draws other numbers, from the same seed
+            Random::Seed(_config.seed + _turn);
+        }
+        if (_treeRoot == nullptr)
+        {
+            _treeRoot = _pool.create(_grid, nullptr, ME, Move());
+        }
+        return mcts(*_treeRoot, deadline);
+    }
+
+    void releaseTree()
+    {
+        if (_treeRoot != nullptr)
+        {
+            _treeRoot->clearChildren(_pool);
+            _pool.destroy(_treeRoot);
+            _treeRoot = nullptr;
+        }
+    }
+
+    // Collapse the least visited subtrees until a quarter of the pool is free again.
+    // Only nodes whose children are all leaves are collapsed, so each pass frees
+    // the deepest rarely visited parts of the tree first.
+    void recycle(TreeElem& root)
+    {
+        int target = _pool.capacity() / 4;
+        vector<TreeElem*> frontier;
+        while (_pool.available() < target)
+        {
+            frontier.clear();
+            collectFrontier(root, frontier);
+            if (frontier.empty())
+            {
+                break;
+            }
+            sort(frontier.begin(), frontier.end(), [](const TreeElem* a, const TreeElem* b) { return a->plays() < b->plays(); });
+            for (TreeElem* elem : frontier)
+            {
+                elem->clearChildren(_pool);
+                if (_pool.available() >= target)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    void collectFrontier(TreeElem& treeElem, vector<TreeElem*>& frontier)
+    {
+        bool childrenAreLeaves = true;
+        for (TreeElem* child : treeElem.getChildren())
+        {
+            if (!child->isLeaf())
+            {
+                childrenAreLeaves = false;
+                collectFrontier(*child, frontier);
+            }
+        }
+        if (childrenAreLeaves && !treeElem.isLeaf() && !treeElem.isRoot())
+        {
+            frontier.push_back(&treeElem);
+        }
+    }
+
+    // Lazy SMP: every thread runs its own iterative deepening on the root, sharing
+    // the transposition table. Odd threads start one iteration deeper and every
+    // thread tries the root moves in its own order, so that they rarely search the
+    // same node at the same time. The deepest completed iteration gives the move.
+    Move playAlphaBeta(const chrono::high_resolution_clock::time_point& deadline)
+    {
+        if (_table == nullptr)
+        {
+            _table.reset(new TranspositionTable((size_t)_config.hashSize << 20));
+        }
+        atomic<bool> stop(false);
+        mutex resultMutex;
+        bufferPossibleMoves_t rootMoves;
+        _grid.getAllPossibleMoves(ME, rootMoves);
+        Move bestMove = rootMoves[0];
+        int bestEval = 0;
+        int bestDepth = -1;
+        atomic<long long> nodes(0);
+        auto work = [&](int id)
+        {
+            AlphaBeta alphaBeta(_table.get(), &stop, deadline);
+            alphaBeta.setTablebase(_tablebase);
+            Grid grid = _grid;
+            for (int depth = id % 2; depth <= _config.minimaxDepth && !alphaBeta.stopped(); depth++)
+            {
+                int eval;
+                if (id == 0)
+                {
+                    PERF_BEGIN(_perf);
+                }
+                Move move = alphaBeta.bestMove(grid, ME, depth, eval, id);
+                if (id == 0)
+                {
+                    PERF_LAP(_perf, PERF_DEPTH + depth);
+                }
+                if (alphaBeta.stopped())
+                {
+                    break;
+                }
+                lock_guard<mutex> lock(resultMutex);
+                if (depth > bestDepth)
+                {
+                    bestDepth = depth;
+                    bestMove = move;
+                    bestEval = eval;
+                }
+            }
+            // The first thread done with the deepest iteration ends the search
+            stop.store(true);
+            nodes += alphaBeta.nodes();
+        };
+        vector<thread> helpers;
+        for (int id = 1; id < _config.threads; id++)
+        {
+            helpers.emplace_back(work, id);
+        }
+        work(0);
+        for (thread& helper : helpers)
+        {
+            helper.join();
+        }
+        DBG(bestEval << " at depth " << bestDepth << ", " << nodes << " nodes");
+        _stats = {(int)min(nodes.load(), (long long)INT32_MAX), (float)bestEval, bestDepth};
+        return bestMove;
+    }
+
+    // HYBRID mode: winner proven by a shallow alpha-beta, only tried when few moves are left
+    Player tacticalWinner(AlphaBeta& alphaBeta, Grid& grid, Player player, int allowedMovesCount, int depth) const
+    {
+        if (_config.mode != HYBRID || allowedMovesCount > _config.hybridMaxMoves)
+        {
+            return NONE;
+        }
+        return alphaBeta.forcedWinner(grid, player, depth);
+    }
+
+    // Monte Carlo Tree Search
+    // https://vgarciasc.github.io/mcts-viz/
+    // https://www.youtube.com/watch?v=UXW2yZndl7U
+    Move mcts(TreeElem& root, const chrono::high_resolution_clock::time_point& deadline)
+    {
+        DBG("mcts");
+        int loops = 0;
+        TreeElem* bestChild;
+        if (_config.rootPolicy == ROOT_HALVING)
+        {
+            bestChild = sequentialHalving(root, deadline, loops);
+        }
+        else
+        {
+            // At least one loop, so that the root is expanded even for a late search.
+            // Stop as soon as the root is proven.
+            while (!root.isSolved() &&
+                (_config.loops > 0 ? loops < _config.loops : loops == 0 || chrono::high_resolution_clock::now() < deadline))
+            {
+                loops += iteration(root, root);
+            }
+            // Chose child with best uct
+            bestChild = root.getChildWithBestAverageScore();
+            //TreeElem* bestChild = root.getChildWithBestUct(_config.exploration, _config.priorWeight);
+        }
+        DBG(loops << " loops, " << _pool.used() << " nodes" << (root.isSolved() ? ", proven" : ""));
+        _turn++;
+        if (_trace != nullptr)
+        {
+            traceTree(root, bestChild != nullptr ? bestChild->move() : Move());
+        }
+        if (bestChild == nullptr)
+        {
+            _stats = {root.plays(), 0.f, 0};
+            return Move();
+        }
+        DBG(bestChild->score() << "/" << bestChild->plays());
+        float value = bestChild->isSolved() ? (bestChild->proven() == ME ? 1.f : 0.f) : (float)bestChild->score() / (float)bestChild->plays();
+        _stats = {root.plays(), value, 0};
+        return bestChild->move();
+    }
+
+    // Selection from treeElem down, then expansion, playout and backpropagation.
+    // Returns the number of playouts.
+    int iteration(TreeElem& root, TreeElem& treeElem)
+    {
+        if (_pool.available() < MAX_POSSIBLE_MOVES)
+        {
+            recycle(root);
+        }
+        PERF_BEGIN(_perf);
+        TreeElem* selected = selection(treeElem);
+        PERF_LAP(_perf, PERF_SELECTION);
+        TreeElem* expanded = expansion(*selected);
+        PERF_LAP(_perf, PERF_EXPANSION);
+        if (_config.leafPlayouts > 0 && expanded != selected)
+        {
+            int playouts = leafPlayouts(*selected);
+            PERF_LAP(_perf, PERF_SIMULATION);
+            return playouts;
+        }
+        Player proven = prove(*expanded, _alphaBeta);
+        PERF_LAP(_perf, PERF_PROOF);
+        int score = proven == NONE ? simulation(*expanded) : proven == ME ? 1 : 0;
+        PERF_LAP(_perf, PERF_SIMULATION);
+        backpropagation(*expanded, score);
+        if (proven != NONE)
+        {
+            propagateProof(*expanded, proven);
+        }
+        PERF_LAP(_perf, PERF_BACKPROPAGATION);
+        return 1;
+    }
+
+    // Sequential halving at the root: the loops, or the time, are split into log2(moves)
+    // rounds, each spread evenly over the remaining root moves, and the worse half of them
+    // is dropped after each round. UCT still selects below the root moves. Unlike UCT, a
+    // move cannot be chosen on a few lucky playouts while the others wait for visits.
+    // With loops, a round plays each remaining move up to the same number of plays, so that
+    // the finalists end even; a batch of leaf playouts may overshoot it.
+    TreeElem* sequentialHalving(TreeElem& root, const chrono::high_resolution_clock::time_point& deadline, int& loops)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        if (root.isLeaf())
+        {
+            loops += iteration(root, root);
+        }
+        vector<TreeElem*> survivors(root.getChildren().begin(), root.getChildren().end());
+        // Proven moves first, then by average, the prior breaking the ties of unvisited moves
+        auto value = [](const TreeElem* child)
+        {
+            if (child->isSolved())
+            {
+                return child->proven() == ME ? 2. : -1.;
+            }
+            return child->plays() > 0 ? (double)child->score() / child->plays() : 0.;
+        };
+        auto rank = [&]()
+        {
+            stable_sort(survivors.begin(), survivors.end(), [&](const TreeElem* a, const TreeElem* b)
+                { return value(a) > value(b) || (value(a) == value(b) && a->prior() > b->prior()); });
+        };
+        if (survivors.size() <= 1)
+        {
+            return survivors.empty() ? root.getChildWithBestAverageScore() : survivors[0];
+        }
+        int rounds = ceil(log2(survivors.size()));
+        int firstLoop = loops;
+        for (int round = 0; round < rounds && survivors.size() > 1 && !root.isSolved(); round++)
+        {
+            int roundLoops = firstLoop + (_config.loops - firstLoop) * (round + 1) / rounds;
+            chrono::high_resolution_clock::time_point roundEnd = start + (deadline - start) * (round + 1) / rounds;
+            // The plays the survivors reach with the loops of the round, shared evenly: the remainder
+            // of the division, and the plays of the root expansion, go to the next rounds
+            int target = roundLoops - loops;
+            for (const TreeElem* survivor : survivors)
+            {
+                target += survivor->plays();
+            }
+            target /= (int)survivors.size();
+            size_t next = 0;
+            size_t done = 0; // survivors in a row that already have the target
+            while (!root.isSolved() && !survivors.empty() &&
+                (_config.loops > 0 ? done < survivors.size() : chrono::high_resolution_clock::now() < roundEnd))
+            {
+                next %= survivors.size();
+                if (survivors[next]->isSolved())
+                {
+                    // Lost, or the root would be solved: only the unsolved moves need playouts
+                    survivors.erase(survivors.begin() + next);
+                    continue;
+                }
+                if (_config.loops > 0 && survivors[next]->plays() >= target)
+                {
+                    next++;
+                    done++;
+                    continue;
+                }
+                done = 0;
+                loops += iteration(root, *survivors[next++]);
+            }
+            rank();
+            survivors.resize((survivors.size() + 1) / 2);
+        }
+        if (root.isSolved() || survivors.empty())
+        {
+            return root.getChildWithBestAverageScore();
+        }
+        rank();
+        return survivors[0];
+    }
+
+    void saveStats(const TreeElem& treeElem, uint64_t hash, int depth)
+    {
+        if (depth > 0)
+        {
+            int wins = treeElem.player() == ME ? treeElem.plays() - treeElem.score() : treeElem.score();
+            _statsCache->add(hash, treeElem.plays(), wins);
+        }
+        if (depth < STATS_CACHE_DEPTH)
+        {
+            for (const TreeElem* child : treeElem.getChildren())
+            {
+                if (child->plays() >= STATS_CACHE_MIN_PLAYS)
+                {
+                    saveStats(*child, hash ^ Zobrist::move(child->move(), treeElem.player()), depth + 1);
+                }
+            }
+        }
+    }
+
+    // Favour the moves to positions that were good for the mover in previous games
+    void seedPriors(const TreeElem& treeElem, const bufferPossibleMoves_t& moves, int count, bufferPriors_t& priors) const
+    {
+        int depth = 0;
+        for (const TreeElem* ancestor = &treeElem; !ancestor->isRoot(); ancestor = ancestor->parent())
+        {
+            if (++depth >= STATS_CACHE_DEPTH)
+            {
+                return;
+            }
+        }
+        uint64_t hash = treeElem.grid().hash(treeElem.player());
+        double sum = 0.;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t visits, wins;
+            if (_statsCache->probe(hash ^ Zobrist::move(moves[i], treeElem.player()), visits, wins))
+            {
+                double average = (wins + 1.) / (visits + 2.);
+                double weight = visits / (visits + STATS_CACHE_CONFIDENCE);
+                priors[i] *= exp(STATS_PRIOR_SCALE * weight * (average - 0.5));
+            }
+            sum += priors[i];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            priors[i] /= sum;
+        }
+    }
+
+    void traceTree(const TreeElem& root, const Move& chosen)
+    {
+        _snapshot.game = _game;
+        _snapshot.turn = _turn;
+        _snapshot.rootPlays = root.plays();
+        _snapshot.chosen = chosen;
+        _snapshot.grid = root.grid().toString();
+        replace(_snapshot.grid.begin(), _snapshot.grid.end(), '\n', '/');
+        _snapshot.nodes.clear();
+        traceChildren(root, 1);
+        _trace->push(_snapshot);
+    }
+
+    void traceChildren(const TreeElem& treeElem, int depth)
+    {
+        if (depth > _config.traceDepth)
+        {
+            return;
+        }
+        for (const TreeElem* child : treeElem.getChildren())
+        {
+            _snapshot.nodes.push_back({(uint8_t)depth, child->move().pack(), (int8_t)child->proven(), child->plays(), child->score(),
+                (float)child->computeUct(_config.exploration, _config.priorWeight), child->prior()});
+            traceChildren(*child, depth + 1);
+        }
+    }
+
+    TreeElem* selection(TreeElem& treeElem)
+    {
+        TreeElem* bestChild = treeElem.isLeaf() ? nullptr : treeElem.getChildWithBestUct(_config.exploration, _config.priorWeight);
+        if (bestChild == nullptr)
+        {
+            return &treeElem;
+        }
+        else
+        {
+            return selection(*bestChild);
+        }
+    }
+
+    TreeElem* expansion(TreeElem& treeElem)
+    {
+        if (treeElem.plays() > 0 || treeElem.isRoot())
+        {
+            // Add all possible children
+            bufferPossibleMoves_t allowedMoves;
+            int movesCount = treeElem.getAllowedMoves(allowedMoves);
+            if (treeElem.isRoot() && _rootParts > 1)
+            {
+                int kept = 0;
+                for (int i = _rootPart; i < movesCount; i += _rootParts)
+                {
+                    allowedMoves[kept++] = allowedMoves[i];
+                }
+                movesCount = kept;
+            }
+            if (movesCount > 0 && movesCount <= _pool.available())
+            {
+                bufferPriors_t priors;
+                _prior.probabilities(treeElem.grid(), treeElem.player(), allowedMoves, movesCount, priors);
+                if (_statsCache != nullptr)
+                {
+                    seedPriors(treeElem, allowedMoves, movesCount, priors);
+                }
+                int mostLikely = 0;
+                treeElem.reserveChildren(movesCount);
+                for (int i = 0; i < movesCount; i++)
+                {
+                    treeElem.addChild(_pool, allowedMoves[i])->setPrior(priors[i]);
+                    if (priors[i] > priors[mostLikely])
+                    {
+                        mostLikely = i;
+                    }
+                }
+                return treeElem.getChildren()[mostLikely];
+            }
+            else
+            {
+                return &treeElem;
+            }
+        }
+        else
+        {
+            return &treeElem;
+        }
+    }
+
+    // Winner known without a playout: the player to move is stuck, a tablebase position,
+    // or a HYBRID forced win. This is the deeper tactical check, the playout only runs cheaper ones.
+    Player prove(const TreeElem& treeElem, AlphaBeta& alphaBeta) const
+    {
+        Grid grid = treeElem.grid();
+        Player player = treeElem.player();
+        bufferPossibleMoves_t allowedMoves;
+        int allowedMovesCount = grid.getAllPossibleMoves(player, allowedMoves);
+        if (allowedMovesCount == 0)
+        {
+            return player == ME ? ENEMY : ME;
+        }
+        if (_tablebase != nullptr)
+        {
+            Player winner = _tablebase->winner(grid, player);
+            if (winner != NONE)
+            {
+                return winner;
+            }
+        }
+        return tacticalWinner(alphaBeta, grid, player, allowedMovesCount, _config.hybridDepth);
+    }
+
+    void propagateProof(TreeElem& treeElem, Player winner)
+    {
+        treeElem.setProven(winner);
+        TreeElem* currentElem = &treeElem;
+        while (!currentElem->isRoot())
+        {
+            currentElem = currentElem->parent();
+            winner = currentElem->provenFromChildren();
+            if (winner == NONE)
+            {
+                break;
+            }
+            currentElem->setProven(winner);
+        }
+    }
+
+public:
+    // Playout from a leaf that prove() could not solve. Only reads the AI, so that
+    // the leaf workers can run it concurrently, each with its own alpha-beta.
+    KERNEL_INLINE int simulationKernel(const TreeElem& leaf, AlphaBeta& alphaBeta, Playout& playout) const
+    {
+        RolloutState state(leaf.grid());
+        Player player = leaf.player();
+        Player winner = NONE;
+        bufferPossibleMoves_t allowedMoves;
+        bool atLeaf = true;
+        // Packed moves of the playout, after the move to the leaf, for the playout policy
+        array<uint16_t, MAX_GRID_CELLS + 1>& played = playout.played;
+        played[0] = leaf.isRoot() ? NO_PREVIOUS_MOVE : leaf.move().pack();
+        int playedCount = 1;
+        // One draw per uniform move: a playout has less moves than cells
+        array<uint32_t, MAX_GRID_CELLS> draws;
+        Random::Fill(draws.data(), MAX_GRID_CELLS);
+        while (winner == NONE)
+        {
+            int allowedMovesCount = state.count(player);
+            if (allowedMovesCount == 0)
+            {
+                winner = player == ME ? ENEMY : ME;
+            }
+            else if (!atLeaf)
+            {
+                if (_tablebase != nullptr && allowedMovesCount <= TABLEBASE_PLAYOUT_MOVES)
+                {
+                    winner = _tablebase->winner(state.grid(), player);
+                }
+                if (winner == NONE)
+                {
+                    winner = tacticalWinner(alphaBeta, state.grid(), player, allowedMovesCount, _config.hybridPlayoutDepth);
+                }
+            }
+            if (winner == NONE)
+            {
+                Move picked;
+                if (_playoutPolicy.enabled() || _config.priorPlayouts)
+                {
+                    state.moves(player, allowedMoves);
+                    int index = _playoutPolicy.enabled()
+                        ? _playoutPolicy.sample(player, played[playedCount - 1], allowedMoves, allowedMovesCount)
+                        : _prior.sample(state.grid(), player, allowedMoves, allowedMovesCount);
+                    picked = allowedMoves[index];
+                }
+                else
+                {
+                    picked = state.sample(player, draws[playedCount - 1]);
+                }
+                state.play(picked);
+                played[playedCount++] = picked.pack();
+                player = player == ME ? ENEMY : ME;
+                atLeaf = false;
+            }
+        }
+        playout.playedCount = playedCount;
+        playout.winner = winner;
+        switch (winner)
+        {
+        case ME:
+            return 1;
+        case ENEMY:
+            return 0;
+        default:
+            return -MY_INFINITY;
+        }
+    }
+
+private:
+    int simulation(TreeElem& leaf)
+    {
+        Playout playout;
+        int score = KERNELS.simulation(*this, leaf, _alphaBeta, playout);
+        if (_playoutPolicy.enabled())
+        {
+            updatePlayoutPolicy(leaf, playout);
+        }
+        return score;
+    }
+
+    // Proofs and leafPlayouts playouts of all the children just added to treeElem, run
+    // as one batch by the search thread and the leaf workers, then backpropagated
+    // together. Returns the number of playouts, a proof counting as one.
+    int leafPlayouts(TreeElem& treeElem)
+    {
+        const vector<TreeElem*>& children = treeElem.getChildren();
+        int count = children.size();
+        int perChild = _config.leafPlayouts;
+        _leafProofs.resize(count);
+        _leafBatch.resize(count * perChild);
+        atomic<int> next(0);
+        auto run = [&](AlphaBeta& alphaBeta)
+        {
+            for (int i = next++; i < count; i = next++)
+            {
+                _leafProofs[i] = prove(*children[i], alphaBeta);
+                for (int p = 0; p < perChild && _leafProofs[i] == NONE; p++)
+                {
+                    KERNELS.simulation(*this, *children[i], alphaBeta, _leafBatch[i * perChild + p]);
+                }
+            }
+        };
+        int workers = min(_config.threads, count) - 1;
+        if (workers > 0 && _leafAlphaBetas.empty())
+        {
+            for (int i = 1; i < _config.threads; i++)
+            {
+                _leafAlphaBetas.emplace_back(new AlphaBeta());
+                _leafAlphaBetas.back()->setTablebase(_tablebase);
+            }
+        }
+        mutex doneMutex;
+        condition_variable done;
+        int pending = workers;
+        for (int worker = 0; worker < workers; worker++)
+        {
+            ThreadPool::shared(_config.threads - 1).push([&, worker]()
+            {
+                run(*_leafAlphaBetas[worker]);
+                lock_guard<mutex> lock(doneMutex);
+                if (--pending == 0)
+                {
+                    done.notify_one();
+                }
+            });
+        }
+        run(_alphaBeta);
+        {
+            unique_lock<mutex> lock(doneMutex);
+            done.wait(lock, [&]() { return pending == 0; });
+        }
+
+        int playouts = 0;
+        for (int i = 0; i < count; i++)
+        {
+            Player proven = _leafProofs[i];
+            if (proven != NONE)
+            {
+                backpropagation(*children[i], proven == ME ? 1 : 0);
+                propagateProof(*children[i], proven);
+                playouts++;
+                continue;
+            }
+            for (int p = 0; p < perChild; p++)
+            {
+                const Playout& playout = _leafBatch[i * perChild + p];
+                backpropagation(*children[i], playout.winner == ME ? 1 : 0);
+                if (_playoutPolicy.enabled())
+                {
+                    updatePlayoutPolicy(*children[i], playout);
+                }
+            }
+            playouts += perChild;
+        }
+        return playouts;
+    }
+
+    // The moves of the tree path count as well as those of the playout
+    void updatePlayoutPolicy(const TreeElem& leaf, const Playout& playout)
+    {
+        Player player = leaf.player();
+        for (int i = 1; i < playout.playedCount; i++)
+        {
+            _playoutPolicy.update(player, playout.played[i - 1], playout.played[i], player == playout.winner);
+            player = player == ME ? ENEMY : ME;
+        }
+        for (const TreeElem* node = &leaf; !node->isRoot(); node = node->parent())
+        {
+            const TreeElem* parent = node->parent();
+            int previous = parent->isRoot() ? NO_PREVIOUS_MOVE : parent->move().pack();
+            _playoutPolicy.update(parent->player(), previous, node->move().pack(), parent->player() == playout.winner);
+        }
+    }
+
+    void backpropagation(TreeElem& treeElem, int score)
+    {
+        treeElem.addScore(score);
+        TreeElem* currentElem = &treeElem;
+        while (!currentElem->isRoot())
+        {
+            currentElem = currentElem->parent();
+            currentElem->addScore(score);
+        }
+    }
+
+    const Grid& _grid;
+    SearchConfig _config;
+    AlphaBeta _alphaBeta;
+    unique_ptr<TranspositionTable> _table;
+    ObjectPool<TreeElem> _pool;
+    MovePrior _prior;
+    const Tablebase* _tablebase;
+    TraceWriter* _trace;
+    string _game;
+    TraceSnapshot _snapshot;
+    StatsCache* _statsCache;
+    PlayoutPolicy _playoutPolicy;
+    int _turn;
+    TreeElem* _treeRoot;
+    int _timeout;
+    SearchStats _stats;
+    int _rootPart;
+    int _rootParts;
+    vector<Player> _leafProofs;
+    vector<Playout> _leafBatch;
+    vector<unique_ptr<AlphaBeta>> _leafAlphaBetas;
+#ifdef PERF_PROFILE
+    PerfProfile _perf;
+#endif
+};
+
+
+#define DEFINE_KERNELS(ISA, SUFFIX, TARGET) \
+    TARGET int allPossibleMoves##SUFFIX(const Grid& grid, Player player, bufferPossibleMoves_t& moves) \
+    { \
+        return grid.getAllPossibleMovesKernel(player, moves); \
+    } \
+    TARGET int evaluate##SUFFIX(const Grid& grid) \
+    { \
+        return evaluateKernel(grid); \
+    } \
+    TARGET TreeElem* bestUct##SUFFIX(const TreeElem& treeElem, double exploration, double priorWeight) \
+    { \
+        return treeElem.getChildWithBestUctKernel(exploration, priorWeight); \
+    } \
+    TARGET int simulation##SUFFIX(const AI& ai, const TreeElem& leaf, AlphaBeta& alphaBeta, Playout& playout) \
+    { \
+        return ai.simulationKernel(leaf, alphaBeta, playout); \
+    } \
+    const Kernels KERNELS##SUFFIX = {ISA, ISA, ISA, allPossibleMoves##SUFFIX, evaluate##SUFFIX, bestUct##SUFFIX, simulation##SUFFIX};
+
+DEFINE_KERNELS(ISA_SCALAR, Scalar, )
+#ifdef TARGET_AVX2
+DEFINE_KERNELS(ISA_AVX2, Avx2, TARGET_AVX2)
+DEFINE_KERNELS(ISA_AVX512, Avx512, TARGET_AVX512)
+#endif
+
+
+bool IsaSupported(Isa isa)
+{
+#ifdef TARGET_AVX2
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi")
+        && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt");
+    switch (isa)
+    {
+    case ISA_SCALAR:
+        return true;
+    case ISA_AVX2:
+        return avx2;
+    case ISA_AVX512:
+        return avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq");
+    default:
+        return false;
+    }
+#else
+    return isa == ISA_SCALAR;
+#endif
+}
+
+
+const Kernels& KernelsFor(Isa isa)
+{
+#ifdef TARGET_AVX2
+    if (isa == ISA_AVX512)
+        return KERNELSAvx512;
+    if (isa == ISA_AVX2)
+        return KERNELSAvx2;
+#endif
+    return KERNELSScalar;
+}
+
+
+Isa BestIsa()
+{
+    for (int isa = ISA_COUNT - 1; isa > ISA_SCALAR; isa--)
+    {
+        if (IsaSupported((Isa)isa))
+        {
+            return (Isa)isa;
+        }
+    }
+    return ISA_SCALAR;
+}
+
+
+// Every fourth position of a fixed 8x8 game, from the full board to the end: the
+// fastest variant depends on how many moves there are
+vector<Grid> CalibrationPositions()
+{
+    vector<Grid> positions;
+    Grid grid(8);
+    for (int x = 0; x < 8; x++)
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            grid.set(Position(x, y), (x + y) % 2 == 0 ? ME : ENEMY);
+        }
+    }
+    Player player = ME;
+    bufferPossibleMoves_t moves;
+    for (int ply = 0; ; ply++)
+    {
+        // KERNELS is not set yet
+        int count = KernelsFor(ISA_SCALAR).allPossibleMoves(grid, player, moves);
+        if (count == 0)
+        {
+            break;
+        }
+        if (ply % 4 == 0)
+        {
+            positions.push_back(grid);
+        }
+        grid.play(moves[ply * 7 % count]);
+        player = player == ME ? ENEMY : ME;
+    }
+    return positions;
+}
+
+
+// Nanoseconds of a call on the calibration positions, the best of a few runs
+template <class Kernel>
+double KernelTime(const vector<Grid>& positions, Kernel kernel)
+{
+    const int RUNS = 5;
+    const int REPEATS = 20;
+    double best = HUGE_VAL;
+    volatile int sink = 0;
+    for (int run = 0; run < RUNS; run++)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        for (int i = 0; i < REPEATS; i++)
+        {
+            for (const Grid& grid : positions)
+            {
+                sink = sink + kernel(grid, i % 2 == 0 ? ME : ENEMY);
+            }
+        }
+        double time = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+        best = min(best, time / (REPEATS * positions.size()));
+    }
+    return best;
+}
+
+
+// The widest supported variant, except for the move generation and the evaluation:
+// through the function pointer, a wider variant of these short kernels is not always faster
+Kernels FastestKernels()
+{
+    Kernels kernels = KernelsFor(BestIsa());
+    vector<Grid> positions = CalibrationPositions();
+    double movegenTime = HUGE_VAL;
+    double evaluateTime = HUGE_VAL;
+    for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+    {
+        if (!IsaSupported((Isa)isa))
+        {
+            continue;
+        }
+        const Kernels& variant = KernelsFor((Isa)isa);
+        bufferPossibleMoves_t moves;
+        double time = KernelTime(positions, [&](const Grid& grid, Player player) { return variant.allPossibleMoves(grid, player, moves); });
+        if (time < movegenTime)
+        {
+            movegenTime = time;
+            kernels.movegenIsa = variant.isa;
+            kernels.allPossibleMoves = variant.allPossibleMoves;
+        }
+        time = KernelTime(positions, [&](const Grid& grid, Player) { return variant.evaluate(grid); });
+        if (time < evaluateTime)
+        {
+            evaluateTime = time;
+            kernels.evaluateIsa = variant.isa;
+            kernels.evaluate = variant.evaluate;
+        }
+    }
+    return kernels;
+}
+
+
+Kernels KERNELS = FastestKernels();
+
+
+// Only before searching: the kernels are not switched under a running search.
+// Every kernel takes isa, for comparisons. Return false if the CPU does not support isa.
+bool SetIsa(Isa isa)
+{
+    if (!IsaSupported(isa))
+    {
+        return false;
+    }
+    KERNELS = KernelsFor(isa);
+    return true;
+}
+
+
+/**
+ * Binary self-play records. A file is a RecordFileHeader followed by games:
+ *   RecordGameHeader
+ *   RecordMoveStats[moveCount]
+ *   uint8_t moves[moveCount]       packed with Move::pack, zero padded to 4 bytes
+ * Games start from GameRecord::startGrid, the first player being ME.
+ * Everything is little endian and 4 bytes aligned, so a mapped file is read in place.
+ */
+const char RECORD_MAGIC[4] = {'C', 'L', 'B', 'R'};
+const uint32_t RECORD_VERSION = 1;
+
+struct RecordFileHeader
+{
+    char magic[4];
+    uint32_t version;
+};
+
+struct RecordGameHeader
+{
+    uint16_t moveCount;
+    uint8_t boardSize;
+    uint8_t winner;     // Player: ME for the first player, NONE if unfinished
+};
+
+struct RecordMoveStats
+{
+    uint32_t visits;
+    float value;
+};
+
+
+struct GameRecord
+{
+    GameRecord(int iboardSize): boardSize(iboardSize), winner(NONE)
+    {}
+
+    // Checkerboard, the first player owning a1
+    static Grid startGrid(int size)
+    {
+        Grid grid(size);
+        for (int x = 0; x < size; x++)
+        {
+            for (int y = 0; y < size; y++)
+            {
+                grid.set({x,y}, (x+y) % 2 == 0 ? ME : ENEMY);
+            }
+        }
+        return grid;
+    }
+
+    void addMove(const Move& move, const SearchStats& searchStats)
+    {
+        moves.push_back(move.pack());
+        stats.push_back({(uint32_t)searchStats.visits, searchStats.value});
+    }
+
+    int boardSize;
+    Player winner;
+    vector<uint8_t> moves;
+    vector<RecordMoveStats> stats;
+};
+
+
+// Streaming appender, buffered by stdio: cheap enough to call after each game
+class GameRecordWriter
+{
+public:
+    GameRecordWriter(const string& path): _file(fopen(path.c_str(), "ab"))
+    {
+        if (_file != nullptr && ftell(_file) == 0)
+        {
+            RecordFileHeader header;
+            copy(RECORD_MAGIC, RECORD_MAGIC + 4, header.magic);
+            header.version = RECORD_VERSION;
+            fwrite(&header, sizeof(header), 1, _file);
+        }
+    }
+
+    GameRecordWriter(const GameRecordWriter&) = delete;
+
+    ~GameRecordWriter()
+    {
+        if (_file != nullptr)
+        {
+            fclose(_file);
+        }
+    }
+
+    bool isOpen() const
+    {
+        return _file != nullptr;
+    }
+
+    // Return false if the file is not open or the game could not be written
+    bool append(const GameRecord& record)
+    {
+        if (!isOpen())
+        {
+            DBG("record file not open, game dropped");
+            return false;
+        }
+        RecordGameHeader header = {(uint16_t)record.moves.size(), (uint8_t)record.boardSize, (uint8_t)record.winner};
+        static const uint8_t PADDING[4] = {0, 0, 0, 0};
+        size_t padding = (4 - record.moves.size() % 4) % 4;
+        bool written = fwrite(&header, sizeof(header), 1, _file) == 1
+            && fwrite(record.stats.data(), sizeof(RecordMoveStats), record.stats.size(), _file) == record.stats.size()
+            && fwrite(record.moves.data(), 1, record.moves.size(), _file) == record.moves.size()
+            && fwrite(PADDING, 1, padding, _file) == padding;
+        if (!written)
+        {
+            DBG("cannot write a game record");
+        }
+        return written;
+    }
+
+    void flush()
+    {
+        if (isOpen())
+        {
+            fflush(_file);
+        }
+    }
+
+private:
+    FILE* _file;
+};
+
+
+// Game of a mapped record file, valid as long as its reader
+struct GameView
+{
+    const RecordGameHeader* header;
+    const RecordMoveStats* stats;
+    const uint8_t* moves;
+
+    int moveCount() const
+    {
+        return header->moveCount;
+    }
+
+    Move move(int i) const
+    {
+        return Move::unpack(moves[i]);
+    }
+};
+
+
+// Iterate the games of a record file mapped in memory, without copy nor parsing
+class GameRecordReader
+{
+public:
+    GameRecordReader(const string& path): _data(nullptr), _size(0), _start(0), _offset(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(RecordFileHeader))
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                _data = static_cast<const uint8_t*>(data);
+                _size = info.st_size;
+                madvise(data, _size, MADV_SEQUENTIAL);
+                const RecordFileHeader* header = reinterpret_cast<const RecordFileHeader*>(_data);
+                if (equal(RECORD_MAGIC, RECORD_MAGIC + 4, header->magic) && header->version == RECORD_VERSION)
+                {
+                    _start = sizeof(RecordFileHeader);
+                }
+                else
+                {
+                    DBG("bad record file " << path);
+                    _start = _size;
+                }
+                _offset = _start;
+            }
+        }
+        close(fd);
+    }
+
+    GameRecordReader(const GameRecordReader&) = delete;
+
+    ~GameRecordReader()
+    {
+        if (_data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(_data), _size);
+        }
+    }
+
+    bool isOpen() const
+    {
+        return _data != nullptr;
+    }
+
+    // Return false at the end of the file, or on a truncated game
+    bool next(GameView& game)
+    {
+        if (_offset + sizeof(RecordGameHeader) > _size)
+        {
+            return false;
+        }
+        game.header = reinterpret_cast<const RecordGameHeader*>(_data + _offset);
+        size_t movesBytes = (game.header->moveCount + 3) / 4 * 4;
+        size_t end = _offset + sizeof(RecordGameHeader) + game.header->moveCount * sizeof(RecordMoveStats) + movesBytes;
+        if (end > _size)
+        {
+            return false;
+        }
+        game.stats = reinterpret_cast<const RecordMoveStats*>(_data + _offset + sizeof(RecordGameHeader));
+        game.moves = reinterpret_cast<const uint8_t*>(game.stats + game.header->moveCount);
+        _offset = end;
+        return true;
+    }
+
+    void rewind()
+    {
+        _offset = _start;
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _start;
+    size_t _offset;
+};
+
+
+// Read one turn of the referee protocol into grid
+void readTurn(istream& in, Grid& grid, char mycolor)
+{
+    for (int y = grid.getSize() -1; y >= 0; y--) {
+        string line; // horizontal row
+        in >> line; in.ignore();
+
+        int x = 0;
+        for (const char& c: line)
         {
-            _parent->_children.clear();
-            _parent->_children.push_back(this);
+            if (c == 'w' || c == 'b')
+            {
+                grid.set({x,y}, mycolor == c ? Player::ME : Player::ENEMY);
+            }
+            else if (c == '.')
+            {
+                grid.set({x,y}, NONE);
+            }
+            ++x;
+        }
+    }
+    string last_action; // last action made by the opponent ("null" if it's the first turn)
+    in >> last_action; in.ignore();
+    int actions_count; // number of legal actions
+    in >> actions_count; in.ignore();
+}
+
+
+/**
+ * Server mode: many games multiplexed on stdin/stdout, searched by a shared pool.
+ *   new <id> <board_size> <color>      start a game
+ *   turn <id>                          followed by the usual turn input
+ *   end <id>                           forget a game
+ * Each turn is answered by "<id> <move>". The turn deadline starts when the
+ * turn is read, so time spent waiting for a free worker counts. A client
+ * must wait for the answer before sending the next turn of the same game.
+ */
+class Server
+{
+public:
+    // memoryLimit is the budget of the whole server: each of the threads gets its share,
+    // and a game frees its tree once its turn is answered
+    Server(int threads, const SearchConfig& config): _config(config), _pool(threads)
+    {
+        _config.memoryLimit /= threads;
+    }
+
+    void run(istream& in, ostream& out)
+    {
+        string command;
+        while (in >> command)
+        {
+            int id;
+            in >> id;
+            if (command == "new")
+            {
+                int boardSize;
+                string color;
+                in >> boardSize >> color; in.ignore();
+                _games[id] = make_shared<Game>(boardSize, color[0], _config);
+            }
+            else if (command == "turn")
+            {
+                in.ignore();
+                auto game = _games.find(id);
+                if (game == _games.end())
+                {
+                    DBG("unknown game " << id);
+                    continue;
+                }
+                shared_ptr<Game> current = game->second;
+                readTurn(in, current->grid, current->color);
+                chrono::high_resolution_clock::time_point deadline = chrono::high_resolution_clock::now()
+                    + chrono::milliseconds(current->firstTurn ? _config.timeoutStart : _config.timeout);
+                current->firstTurn = false;
+                _pool.push([this, &out, id, current, deadline]()
+                {
+                    string move = current->ai.play(deadline).toString();
+                    {
+                        lock_guard<mutex> lock(_outMutex);
+                        out << id << " " << move << endl;
+                    }
+                    current->ai.saveStats();
+                    current->ai.releaseMemory();
+                });
+            }
+            else if (command == "end")
+            {
+                // A search still running keeps its game alive through its shared_ptr
+                _games.erase(id);
+                StatsCache* statsCache = StatsCache::shared(_config.statsCache, (size_t)_config.statsCacheSize << 20);
+                if (statsCache != nullptr)
+                {
+                    statsCache->sync();
+                }
+            }
+            else
+            {
+                DBG("unknown command " << command);
+            }
         }
     }
 
 private:
-    Grid _grid;
-    TreeElem* _parent;
-    vector<TreeElem*> _children;
-    Player _player; // The player that will play at this stage
-    Move _move; // The move that lead to this node
-    int _score;
-    int _plays;
+    struct Game
+    {
+        Game(int boardSize, char icolor, const SearchConfig& config): grid(boardSize), ai(grid, config), color(icolor), firstTurn(true)
+        {}
+
+        Grid grid;
+        AI ai;
+        char color;
+        bool firstTurn;
+    };
+
+    SearchConfig _config;
+    map<int, shared_ptr<Game>> _games;
+    mutex _outMutex;
+    ThreadPool _pool; // last: destroyed first, its remaining tasks still use the members above
 };
 
 
-class AI
+/**
+ * Distributed root search over Unix domain sockets, one line per message:
+ *   search <turn> <budget ms> <part> <parts> <board size> <Grid::toString with '/' between rows>
+ *   <turn> <move>:<plays>:<score>:<proven> ...
+ * With parts > 1, a worker only searches its share of the root moves,
+ * otherwise all workers search the whole root independently.
+ */
+int ListenUnix(const string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 4) < 0)
+    {
+        DBG("cannot listen on " << path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+
+// Retry until the deadline, to let workers start after the coordinator
+int ConnectUnix(const string& path, const chrono::high_resolution_clock::time_point& deadline)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    while (true)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) == 0)
+        {
+            return fd;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (chrono::high_resolution_clock::now() >= deadline)
+        {
+            DBG("cannot connect to " << path);
+            return -1;
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+}
+
+
+bool WriteAll(int fd, const string& data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count <= 0)
+        {
+            return false;
+        }
+        written += count;
+    }
+    return true;
+}
+
+
+// Line buffered reads on a socket
+class LineSocket
 {
 public:
-    AI(const Grid& grid): _grid(grid), _treeRoot(nullptr), _timeout(TIMEOUT_START)
+    LineSocket(int fd): _fd(fd)
     {}
 
-    // Return pair<from, to>
-    Move play()
+    LineSocket(const LineSocket&) = delete;
+
+    ~LineSocket()
     {
-        // TODO remove if we want to reuse tree
-        _treeRoot = nullptr;
-        if (_treeRoot == nullptr)
+        if (_fd >= 0)
         {
-            _treeRoot = new TreeElem(_grid, nullptr, ME, Move());
+            close(_fd);
         }
-        Move pos = mcts(*_treeRoot);
-        // After first turn, timeout is 100 ms
-        _timeout = TIMEOUT;
-        return pos;
     }
 
-    int evaluate(const Grid& grid)
+    int fd() const
+    {
+        return _fd;
+    }
+
+    bool isOpen() const
     {
-        int eval = 0;
+        return _fd >= 0;
+    }
 
-        bufferNeighbours_t neighbours;
+    bool write(const string& line)
+    {
+        return _fd >= 0 && WriteAll(_fd, line + "\n");
+    }
 
-        for (int y = 0; y < grid.getSize(); y++)
+    // Wait at most timeout ms (forever if negative). Return false on timeout or closed socket.
+    bool readLine(string& line, int timeout)
+    {
+        while (!extractLine(line))
         {
-            for (int x = 0; x < grid.getSize(); x++)
+            if (_fd < 0)
             {
-                switch (grid.get(x,y))
-                {
-                case NONE:
-                    break;
-                case ME:
-                    if (grid.getPossibleMoves({x,y}, neighbours) > 0)
-                    {
-                        eval++;
-                    }
-                    break;
-                case ENEMY:
-                    if (grid.getPossibleMoves({x,y}, neighbours) > 0)
-                    {
-                        eval--;
-                    }
-                    break;
-                }
+                return false;
+            }
+            pollfd request = {_fd, POLLIN, 0};
+            if (poll(&request, 1, timeout) <= 0 || !receive())
+            {
+                return false;
             }
         }
-        return eval;
+        return true;
     }
 
 private:
-    // Monte Carlo Tree Search
-    // https://vgarciasc.github.io/mcts-viz/
-    // https://www.youtube.com/watch?v=UXW2yZndl7U
-    Move mcts(TreeElem& root)
+    bool extractLine(string& line)
     {
-        DBG("mcts");
-        int loops = 0;
-        chrono::time_point<chrono::high_resolution_clock> start = chrono::high_resolution_clock::now();
-#ifndef MCTS_LOOPS_LIMIT
-        while (chrono::duration_cast<std::chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count() < _timeout)
-#else
-        for (int i = 0; i < MCTS_LOOPS_LIMIT; i++)
-#endif
+        size_t end = _buffer.find('\n');
+        if (end == string::npos)
         {
-            TreeElem* selected = selection(root);
-            TreeElem* expanded = expansion(*selected);
-            int score = simulation(*expanded);
-            backpropagation(*expanded, score);
-            loops++;
+            return false;
         }
-        DBG(loops << " loops");
-        // Chose child with best uct
-        TreeElem* bestChild = root.getChildWithBestAverageScore();
-        //TreeElem* bestChild = root.getChildWithBestUct();
-        DBG(bestChild->score() << "/" << bestChild->plays());
-        return bestChild->move();
+        line = _buffer.substr(0, end);
+        _buffer.erase(0, end + 1);
+        return true;
     }
 
-    TreeElem* selection(TreeElem& treeElem)
+    bool receive()
     {
-        if (treeElem.isLeaf())
+        char data[4096];
+        ssize_t count = recv(_fd, data, sizeof(data), 0);
+        if (count <= 0)
         {
-            return &treeElem;
+            close(_fd);
+            _fd = -1;
+            return false;
         }
-        else
+        _buffer.append(data, count);
+        return true;
+    }
+
+    int _fd;
+    string _buffer;
+};
+
+
+// Answer search requests of one coordinator at a time
+class DistributedWorker
+{
+public:
+    DistributedWorker(const string& path, const SearchConfig& config): _listener(ListenUnix(path)), _path(path), _config(config)
+    {}
+
+    ~DistributedWorker()
+    {
+        if (_listener >= 0)
         {
-            return selection(*treeElem.getChildWithBestUct());
+            close(_listener);
+            unlink(_path.c_str());
         }
     }
 
-    TreeElem* expansion(TreeElem& treeElem)
+    bool isListening() const
     {
-        if (treeElem.plays() > 0 || treeElem.isRoot())
+        return _listener >= 0;
+    }
+
+    // Serve that many coordinators, forever if negative
+    void run(int connections = -1)
+    {
+        for (int served = 0; _listener >= 0 && served != connections; served++)
         {
-            // Add all possible children
-            bufferPossibleMoves_t allowedMoves;
-            int movesCount = treeElem.getAllowedMoves(allowedMoves);
-            if (movesCount > 0)
+            LineSocket coordinator(accept(_listener, nullptr, nullptr));
+            string line;
+            while (coordinator.readLine(line, -1))
             {
-                for (int i = 0; i < movesCount; i++)
+                string answer = search(line);
+                if (!answer.empty() && !coordinator.write(answer))
                 {
-                    treeElem.addChild(allowedMoves[i]);
+                    break;
                 }
-                return treeElem.getChildren()[0];
-            }
-            else
-            {
-                return &treeElem;
             }
         }
-        else
+    }
+
+private:
+    string search(const string& request)
+    {
+        istringstream in(request);
+        string command;
+        int turn, budget, part, parts, size;
+        string rows;
+        if (!(in >> command >> turn >> budget >> part >> parts >> size >> rows) || command != "search"
+            || size < 1 || size > MAX_GRID_SIZE || parts < 1 || part < 0 || part >= parts)
         {
-            return &treeElem;
+            DBG("bad request " << request);
+            return "";
+        }
+        chrono::high_resolution_clock::time_point deadline = chrono::high_resolution_clock::now() + chrono::milliseconds(budget);
+        Grid grid = Grid::parse(size, rows);
+        AI ai(grid, _config);
+        ai.setRootPart(part, parts);
+        ai.play(deadline);
+        string answer = to_string(turn);
+        for (const RootStat& stat : ai.rootStats())
+        {
+            answer += " " + stat.move.toString() + ":" + to_string(stat.plays) + ":" + to_string(stat.score) + ":" + to_string(stat.proven);
         }
+        return answer;
     }
 
-    int simulation(TreeElem& treeElem)
+    int _listener;
+    string _path;
+    SearchConfig _config;
+};
+
+
+// Search locally while the workers search too, then merge the root statistics.
+// Workers answering later than MERGE_MARGIN before the deadline are left out of the turn.
+class DistributedCoordinator
+{
+public:
+    DistributedCoordinator(const vector<string>& paths, const SearchConfig& config, bool split):
+        _config(config),
+        _split(split),
+        _turn(0)
     {
-        Grid grid = treeElem.grid();
-        Player player = treeElem.player();
-        Player winner = NONE;
-        bufferPossibleMoves_t allowedMoves;
-        while (winner == NONE)
+        chrono::high_resolution_clock::time_point deadline = chrono::high_resolution_clock::now() + chrono::seconds(5);
+        for (const string& path : paths)
         {
-            int allowedMovesCount = grid.getAllPossibleMoves(player, allowedMoves);
-            if (allowedMovesCount == 0)
+            _workers.emplace_back(new LineSocket(ConnectUnix(path, deadline)));
+        }
+    }
+
+    Move play(const Grid& grid, const chrono::high_resolution_clock::time_point& deadline)
+    {
+        if (_config.mode == ALPHABETA)
+        {
+            // Only the MCTS root statistics can be merged
+            AI ai(grid, _config);
+            return ai.play(deadline);
+        }
+        _turn++;
+        int parts = _split ? (int)_workers.size() + 1 : 1;
+        chrono::high_resolution_clock::time_point searchEnd = deadline - chrono::milliseconds(MERGE_MARGIN);
+        int budget = max(1, (int)chrono::duration_cast<chrono::milliseconds>(searchEnd - chrono::high_resolution_clock::now()).count());
+        string rows = grid.toString();
+        replace(rows.begin(), rows.end(), '\n', '/');
+        for (size_t i = 0; i < _workers.size(); i++)
+        {
+            _workers[i]->write("search " + to_string(_turn) + " " + to_string(budget) + " " + to_string(_split ? i + 1 : 0)
+                + " " + to_string(parts) + " " + to_string(grid.getSize()) + " " + rows);
+        }
+
+        AI ai(grid, _config);
+        ai.setRootPart(0, parts);
+        Move local = ai.play(searchEnd);
+        vector<RootStat> merged = ai.rootStats();
+
+        int answers = 0;
+        for (unique_ptr<LineSocket>& worker : _workers)
+        {
+            string line;
+            // Skip the late answers of previous turns
+            while (worker->readLine(line, remaining(deadline)))
             {
-                winner = player == ME ? ENEMY : ME;
+                istringstream in(line);
+                int turn;
+                in >> turn;
+                if (turn == _turn)
+                {
+                    merge(in, merged);
+                    answers++;
+                    break;
+                }
+            }
+        }
+        DBG(answers << "/" << _workers.size() << " workers merged");
+        return merged.empty() ? local : choose(merged);
+    }
+
+private:
+    static int remaining(const chrono::high_resolution_clock::time_point& deadline)
+    {
+        return max(0, (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::high_resolution_clock::now()).count());
+    }
+
+    static void merge(istream& in, vector<RootStat>& merged)
+    {
+        string stat;
+        while (in >> stat)
+        {
+            istringstream fields(stat);
+            string move;
+            int plays, score, proven;
+            char separator;
+            getline(fields, move, ':');
+            if (move.size() != 4 || !(fields >> plays >> separator >> score >> separator >> proven))
+            {
+                continue;
+            }
+            Move parsed({move[0] - 'a', move[1] - '1'}, {move[2] - 'a', move[3] - '1'});
+            auto existing = find_if(merged.begin(), merged.end(), [&](const RootStat& s) { return s.move == parsed; });
+            if (existing == merged.end())
+            {
+                merged.push_back({parsed, plays, score, (Player)proven});
             }
             else
             {
-                Move picked = allowedMoves[Random::Rand(allowedMovesCount)];
-                grid.set(picked.from, NONE);
-                grid.set(picked.to, player);
-                player = player == ME ? ENEMY : ME;
+                existing->plays += plays;
+                existing->score += score;
+                if (proven != NONE)
+                {
+                    existing->proven = (Player)proven;
+                }
             }
         }
-        switch (winner)
-        {
-        case ME:
-            return 1;
-        case ENEMY:
-            return 0;
-        default:
-            return -MY_INFINITY;
-        }
     }
 
-    void backpropagation(TreeElem& treeElem, int score)
+    // Same rule as TreeElem::getChildWithBestAverageScore
+    static Move choose(const vector<RootStat>& stats)
     {
-        treeElem.addScore(score);
-        TreeElem* currentElem = &treeElem;
-        while (!currentElem->isRoot())
+        const RootStat* best = nullptr;
+        for (const RootStat& stat : stats)
         {
-            currentElem = currentElem->parent();
-            currentElem->addScore(score);
+            if (stat.proven == ME)
+            {
+                return stat.move;
+            }
+            if (stat.proven == NONE && stat.plays > 0
+                && (best == nullptr || (double)stat.score / stat.plays > (double)best->score / best->plays))
+            {
+                best = &stat;
+            }
+        }
+        if (best == nullptr)
+        {
+            for (const RootStat& stat : stats)
+            {
+                if (best == nullptr || stat.plays > best->plays)
+                {
+                    best = &stat;
+                }
+            }
         }
+        return best != nullptr ? best->move : Move();
     }
 
-    const Grid& _grid;
-    TreeElem* _treeRoot;
-    int _timeout;
+    SearchConfig _config;
+    bool _split;
+    int _turn;
+    vector<unique_ptr<LineSocket>> _workers;
 };
 
 
+#ifndef SEARCH_MODE
+#define SEARCH_MODE MCTS
+#endif
+
+
 /**
  * Auto-generated code below aims at helping you parse
  * the standard input according to the problem statement.
  **/
 #ifndef LOCAL
-int main()
+int main(int argc, char** argv)
 {
     Random::Init();
 
+    // clobber [--server [threads]] [--worker=socket] [--workers=socket,socket... [--split]] [--config=file] [--key=value]...
+    SearchConfig config(SEARCH_MODE);
+    bool serverMode = false;
+    string workerPath;
+    vector<string> workerPaths;
+    bool split = false;
+    int threads = thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--server")
+        {
+            serverMode = true;
+            if (i + 1 < argc && isdigit(argv[i+1][0]))
+            {
+                threads = stoi(argv[++i]);
+            }
+        }
+        else if (argument.compare(0, 9, "--worker=") == 0)
+        {
+            workerPath = argument.substr(9);
+        }
+        else if (argument.compare(0, 10, "--workers=") == 0)
+        {
+            istringstream paths(argument.substr(10));
+            string path;
+            while (getline(paths, path, ','))
+            {
+                workerPaths.push_back(path);
+            }
+        }
+        else if (argument == "--split")
+        {
+            split = true;
+        }
+        else if (!config.parse(argument))
+        {
+            DBG("unknown argument " << argument);
+        }
+    }
+
+    if (serverMode)
+    {
+        Server server(max(threads, 1), config);
+        server.run(cin, cout);
+        return 0;
+    }
+    if (!workerPath.empty())
+    {
+        DistributedWorker worker(workerPath, config);
+        worker.run();
+        return 0;
+    }
+    unique_ptr<DistributedCoordinator> coordinator;
+    if (!workerPaths.empty())
+    {
+        coordinator.reset(new DistributedCoordinator(workerPaths, config, split));
+    }
+
     int board_size; // height and width of the board
     cin >> board_size; cin.ignore();
     string mycolor; // current color of your pieces ("w" or "b")
     cin >> mycolor; cin.ignore();
 
     Grid grid{board_size};
-    AI ai(grid);
+    AI ai(grid, config);
+    bool first = true;
 
     // game loop
     while (1) {
 
-        for (int y = board_size -1; y >= 0; y--) {
-            string line; // horizontal row
-            cin >> line; cin.ignore();
-
-            int x = 0;
-            for (const char& c: line)
-            {
-                if (c == 'w' || c == 'b')
-                {
-                    grid.set({x,y}, mycolor[0] == c ? Player::ME : Player::ENEMY);
-                }
-                else if (c == '.')
-                {
-                    grid.set({x,y}, NONE);
-                }
-                ++x;
-            }
-        }
-        string last_action; // last action made by the opponent ("null" if it's the first turn)
-        cin >> last_action; cin.ignore();
-        int actions_count; // number of legal actions
-        cin >> actions_count; cin.ignore();
+        readTurn(cin, grid, mycolor[0]);
 
         //DBG(grid.toString());
 
         // Write an action using cout. DON'T FORGET THE "<< endl"
         // To debug: cerr << "Debug messages..." << endl;
 
+        if (coordinator)
+        {
+            int timeout = first ? config.timeoutStart : config.timeout;
+            first = false;
+            cout << coordinator->play(grid, chrono::high_resolution_clock::now() + chrono::milliseconds(timeout)).toString() << endl;
+            continue;
+        }
+
         cout << ai.play().toString() << endl; // e.g. e2e3 (move piece at e2 to e3)
+        ai.saveStats();
     }
 }
 #endif
\ No newline at end of file
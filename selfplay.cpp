@@ -0,0 +1,71 @@
+// Play the engine against itself and append the games to a record file.
+// Usage: selfplay <records> [games] [--key=value]...
+#define LOCAL
+#ifndef MCTS_LOOPS_LIMIT
+#define MCTS_LOOPS_LIMIT 10000
+#endif
+
+#include "clobber.cpp"
+
+
+// The AI always plays ME, so the second player searches the swapped grid
+GameRecord PlayGame(int boardSize, const SearchConfig& config)
+{
+    GameRecord record(boardSize);
+    Grid grid = GameRecord::startGrid(boardSize);
+    Player mover = ME;
+    bufferPossibleMoves_t moves;
+    while (true)
+    {
+        Grid view = mover == ME ? grid : grid.swapped();
+        if (view.getAllPossibleMoves(ME, moves) == 0)
+        {
+            record.winner = mover == ME ? ENEMY : ME;
+            return record;
+        }
+        AI ai(view, config);
+        Move move = ai.play(chrono::high_resolution_clock::now() + chrono::milliseconds(config.timeout));
+        record.addMove(move, ai.stats());
+        ai.saveStats();
+        grid.play(move);
+        mover = mover == ME ? ENEMY : ME;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    Random::Init();
+
+    if (argc < 2)
+    {
+        DBG("usage: selfplay <records> [games] [--key=value]...");
+        return 1;
+    }
+    int games = 100;
+    SearchConfig config;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (isdigit(argument[0]))
+            games = stoi(argument);
+        else if (!config.parse(argument))
+            DBG("unknown argument " << argument);
+    }
+
+    GameRecordWriter writer(argv[1]);
+    if (!writer.isOpen())
+    {
+        DBG("cannot open " << argv[1]);
+        return 1;
+    }
+    for (int game = 0; game < games; game++)
+    {
+        if (!writer.append(PlayGame(8, config)))
+        {
+            return 1;
+        }
+        writer.flush();
+        DBG("game " << game + 1 << "/" << games);
+    }
+}
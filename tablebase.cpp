@@ -0,0 +1,30 @@
+// Solve every region of up to N cells fitting on 8x8, with every colouring,
+// and write their outcome classes for the tablebase search parameter.
+// Usage: tablebase <file> [cells]
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        DBG("usage: tablebase <file> [cells]");
+        return 1;
+    }
+    int cells = argc > 2 ? stoi(argv[2]) : 8;
+    if (cells < 1 || cells > 12)
+    {
+        DBG("cells must be between 1 and 12");
+        return 1;
+    }
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+    TablebaseBuilder builder(cells);
+    if (!builder.write(argv[1]))
+    {
+        return 1;
+    }
+    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+    DBG("written in " << elapsed.count() << " s");
+}
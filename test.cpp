@@ -4,6 +4,7 @@
 #include "clobber.cpp"
 
 #include <assert.h>
+#include <set>
 
 
 Grid BuildGrid(const string& str)
@@ -107,6 +108,181 @@ void testGridCompleted()
     assert(!grid.completed());
 }
 
+void testAlphaBeta()
+{
+    AlphaBeta alphaBeta;
+    int eval;
+    Grid grid(8);
+    grid.set({0,0}, ME);
+    grid.set({1,0}, ENEMY);
+    assert(alphaBeta.forcedWinner(grid, ME, 1) == ME);
+    assert(alphaBeta.bestMove(grid, ME, 1, eval) == Move({0,0}, {1,0}));
+    assert(eval >= WIN_SCORE);
+    grid.set({1,1}, ENEMY);
+    assert(alphaBeta.forcedWinner(grid, ME, 1) == NONE);
+    assert(alphaBeta.forcedWinner(grid, ME, 2) == ENEMY);
+    AI ai(grid, HYBRID);
+    assert(ai.play() == Move({0,0}, {1,0}));
+}
+
+void testLazySmp()
+{
+    Grid grid = BuildGrid(  "-O----O-"
+                            "--OOO--O"
+                            "---O----"
+                            "-XX--O--"
+                            "-XO-----"
+                            "X-O-X-O-"
+                            "OOXX-OXX"
+                            "--XXXXX-");
+    SearchConfig config(ALPHABETA);
+    config.threads = 3;
+    config.minimaxDepth = 4;
+    AI ai(grid, config);
+    Move move = ai.play();
+    assert(grid.get(move.from) == ME && grid.get(move.to) == ENEMY);
+    assert(ai.stats().depth == 4 && ai.stats().visits > 0);
+    // Same grid after the move and its undo: same hash
+    uint64_t hash = grid.hash(ME);
+    grid.play(move);
+    assert(grid.hash(ENEMY) == (hash ^ Zobrist::move(move, ME)));
+    grid.undo(move);
+    assert(grid.hash(ME) == hash);
+}
+
+void testMoveOrdering()
+{
+    Grid grid = BuildGrid(  "XOXOXOXO"
+                            "OXOXOXOX"
+                            "XOX-XOXO"
+                            "OXOXOXX-"
+                            "XOXOXOXO"
+                            "OX-XO-OX"
+                            "XOO-XOXO"
+                            "OXOXOXOX");
+    AlphaBeta plain;
+    plain.setOrdering(false);
+    AlphaBeta ordered;
+    for (int depth = 0; depth <= 3; depth++)
+    {
+        int plainValue;
+        int orderedValue;
+        plain.bestMove(grid, ME, depth, plainValue);
+        ordered.bestMove(grid, ME, depth, orderedValue);
+        assert(plainValue == orderedValue);
+    }
+    assert(ordered.nodes() < plain.nodes());
+}
+
+void testMovePrior()
+{
+    Grid grid(8);
+    grid.set({0,0}, ME);
+    grid.set({1,0}, ENEMY);
+    grid.set({1,1}, ENEMY);
+    grid.set({2,0}, ME);
+    bufferPossibleMoves_t moves;
+    int count = grid.getAllPossibleMoves(ME, moves);
+    assert(count == 2);
+    bufferFeatures_t features;
+    MovePrior::features(grid, ME, moves, count, features);
+    assert(moves[0] == Move({0,0}, {1,0}));
+    assert(features[0][0] == 1 && features[1][0] == 0);
+    assert(features[2][0] == 1 && features[3][0] == 1);
+    bufferPriors_t priors;
+    MovePrior(MOVE_PRIOR_WEIGHTS).probabilities(grid, ME, moves, count, priors);
+    assert(fabs(priors[0] + priors[1] - 1.f) < 1e-5f);
+}
+
+void testMovePacking()
+{
+    for (int x = 0; x < 8; x++)
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            Move right({x,y}, {x+1,y});
+            Move down({x,y}, {x,y-1});
+            assert(Move::unpack(right.pack()) == right);
+            assert(Move::unpack(down.pack()) == down);
+        }
+    }
+}
+
+void testGameRecords()
+{
+    const char* path = "test_records.bin";
+    remove(path);
+    {
+        GameRecordWriter writer(path);
+        GameRecord record(8);
+        record.addMove(Move({0,0}, {1,0}), {1234, 0.75f, 0});
+        record.addMove(Move({2,0}, {1,0}), {99, 0.5f, 0});
+        record.winner = ENEMY;
+        assert(writer.append(record) && writer.append(GameRecord(6)));
+    }
+    GameRecordWriter missing("no_such_directory/records.bin");
+    assert(!missing.isOpen() && !missing.append(GameRecord(6)));
+    GameRecordReader reader(path);
+    GameView game;
+    assert(reader.next(game));
+    assert(game.moveCount() == 2 && game.header->boardSize == 8 && game.header->winner == ENEMY);
+    assert(game.move(1) == Move({2,0}, {1,0}));
+    assert(game.stats[0].visits == 1234 && game.stats[0].value == 0.75f);
+    assert(reader.next(game));
+    assert(game.moveCount() == 0 && game.header->boardSize == 6);
+    assert(!reader.next(game));
+    remove(path);
+}
+
+void testSearchConfig()
+{
+    SearchConfig config(HYBRID);
+    assert(config.get("mode") == "hybrid");
+    assert(config.parse("--exploration=1.5") && config.exploration == 1.5);
+    assert(config.parse("loops=42") && config.loops == 42);
+    assert(!config.parse("--unknown=1") && !config.parse("--server"));
+    // Typos are rejected and keep the previous value
+    assert(!config.parse("--loops=many") && !config.parse("--seed=99999999999999999999") && config.loops == 42);
+    assert(!config.parse("--mode=hybird") && config.mode == HYBRID);
+    assert(!config.parse("--playoutPolicy=mats") && config.playoutPolicy == PLAYOUT_RANDOM);
+    // So are trailing characters, negative sizes and out of range values
+    assert(!config.parse("--loops=12abc") && !config.parse("--loops=-1") && config.loops == 42);
+    assert(!config.parse("--memoryLimit=-5") && config.memoryLimit == TREE_MEMORY_LIMIT);
+    assert(!config.parse("--hashSize=-1") && !config.parse("--hashSize=0") && !config.parse("--hashSize=100000"));
+    assert(config.hashSize == HASH_SIZE && config.parse("--hashSize=64") && config.hashSize == 64);
+    assert(!config.parse("--playoutEpsilon=2") && !config.parse("--exploration=1.5x") && config.exploration == 1.5);
+    assert(!config.parse("--priorPlayouts=yes") && !config.priorPlayouts);
+    assert(config.parse("--priorPlayouts=true") && config.priorPlayouts && config.parse("--priorPlayouts=0") && !config.priorPlayouts);
+    istringstream file("# comment\nmode = alphabeta\nminimaxDepth=5 # deeper\nmemoryLimit=64\n");
+    config.load(file);
+    assert(config.mode == ALPHABETA && config.minimaxDepth == 5 && config.memoryLimit == (size_t)64 << 20);
+    SearchConfig copy;
+    istringstream saved(config.toString());
+    copy.load(saved);
+    assert(copy.toString() == config.toString());
+}
+
+void testMctsSolver()
+{
+    // Every move of ME loses: the enemy captures back and ME is stuck
+    Grid grid(8);
+    grid.set({0,0}, ME);
+    grid.set({1,0}, ENEMY);
+    grid.set({1,1}, ENEMY);
+    AI ai(grid);
+    ai.play();
+    assert(ai.stats().visits < 10 && ai.stats().value == 0.f);
+    // a1b1 wins whatever the enemy answers, a2a3 loses at once
+    grid.set({1,1}, NONE);
+    grid.set({0,2}, ENEMY);
+    grid.set({0,1}, ME);
+    grid.set({2,0}, ENEMY);
+    AI ai2(grid);
+    Move move = ai2.play();
+    assert(ai2.stats().visits < 100 && ai2.stats().value == 1.f);
+    assert(move == Move({0,0}, {1,0}));
+}
+
 void testMcts()
 {
     Grid grid = BuildGrid(  "XOXOXOXO"
@@ -137,6 +313,432 @@ void testMcts2()
     assert(ai.play().toString() == "c2b2");
 }
 
+void testMctsMemoryLimit()
+{
+    Grid grid = BuildGrid(  "XOXOXOXO"
+                            "OXOXOXOX"
+                            "XOXOXOXO"
+                            "OXOXOXOX"
+                            "XOXOXOXO"
+                            "OXOXOXOX"
+                            "XOXOXOXO"
+                            "OXOXOXOX");
+    AI ai(grid);
+    ai.setMemoryLimit(2000 * AI::NODE_BYTES);
+    Move move = ai.play();
+    assert(ai.treeSize() <= 2000);
+    assert(grid.get(move.from) == ME && grid.get(move.to) == ENEMY);
+
+    // Without budget, the root and its children still fit
+    SearchConfig config;
+    config.memoryLimit = 0;
+    AI starved(grid, config);
+    move = starved.play();
+    assert(starved.treeSize() <= 1 + MAX_POSSIBLE_MOVES);
+    assert(grid.get(move.from) == ME && grid.get(move.to) == ENEMY);
+}
+
+void testServer()
+{
+    string board =  "wbwbwbwb\nbwbwbwbw\nwbwbwbwb\nbwbwbwbw\n"
+                    "wbwbwbwb\nbwbwbwbw\nwbwbwbwb\nbwbwbwbw\n";
+    istringstream in("new 1 8 w\nnew 2 8 b\n"
+                     "turn 1\n" + board + "null\n112\n"
+                     "turn 2\n" + board + "null\n112\n"
+                     "end 1\n");
+    ostringstream out;
+    {
+        Server server(2, MCTS);
+        server.run(in, out);
+    }
+    istringstream answers(out.str());
+    set<int> ids;
+    int id;
+    string move;
+    while (answers >> id >> move)
+    {
+        assert(move.size() == 4);
+        ids.insert(id);
+    }
+    assert(ids == set<int>({1, 2}));
+}
+
+
+void testDistributed()
+{
+    Grid grid = Grid::parse(4, "XO-O/OXOX/XOXO/OXOX");
+    assert(grid.toString() == "XO-O\nOXOX\nXOXO\nOXOX");
+    assert(Grid::parse(2, "XOXO/OXOX").toString() == "XO\nXO");
+
+    string path = "test_worker.sock";
+    DistributedWorker worker(path, MCTS);
+    assert(worker.isListening());
+    thread serving([&]() { worker.run(2); });
+    bufferPossibleMoves_t moves;
+    int count = grid.getAllPossibleMoves(ME, moves);
+    {
+        DistributedCoordinator coordinator({path}, MCTS, true);
+        Move move = coordinator.play(grid, chrono::high_resolution_clock::now() + chrono::seconds(2));
+        assert(find(moves.begin(), moves.begin() + count, move) != moves.begin() + count);
+    }
+    {
+        // Requests with a grid size the Grid cannot hold are not answered
+        LineSocket coordinator(ConnectUnix(path, chrono::high_resolution_clock::now() + chrono::seconds(1)));
+        assert(coordinator.write("search 1 10 0 1 9 XOXOXOXOX") && coordinator.write("search 2 10 0 1 0 X"));
+        assert(coordinator.write("search 3 10 0 1 4 XO-O/OXOX/XOXO/OXOX"));
+        string answer;
+        assert(coordinator.readLine(answer, 2000) && answer.compare(0, 2, "3 ") == 0);
+    }
+    serving.join();
+
+    // Alpha-beta has no root statistics to merge: the coordinator searches alone
+    DistributedCoordinator alone({}, ALPHABETA, false);
+    Move move = alone.play(grid, chrono::high_resolution_clock::now() + chrono::milliseconds(100));
+    assert(find(moves.begin(), moves.begin() + count, move) != moves.begin() + count);
+}
+
+
+void testTablebase()
+{
+    string path = "test_tablebase.bin";
+    assert(TablebaseBuilder(5).write(path));
+    const Tablebase* tablebase = Tablebase::shared(path);
+    assert(tablebase != nullptr && tablebase->maxCells() == 5);
+
+    // Small random regions, solved completely by the alpha-beta
+    AlphaBeta alphaBeta;
+    int decided = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        Grid grid(8);
+        for (int x = 0; x < 8; x++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                if (Random::Rand(3) == 0)
+                {
+                    grid.set({x,y}, Random::Rand(2) == 0 ? ME : ENEMY);
+                }
+            }
+        }
+        Player player = i % 2 == 0 ? ME : ENEMY;
+        Player winner = tablebase->winner(grid, player);
+        if (winner != NONE)
+        {
+            assert(alphaBeta.forcedWinner(grid, player, 64) == winner);
+            decided++;
+        }
+    }
+    assert(decided > 0);
+    remove(path.c_str());
+}
+
+
+void testTrace()
+{
+    string path = "test_trace.jsonl";
+    remove(path.c_str());
+    {
+        TraceWriter writer(path);
+        TraceSnapshot snapshot = {"42-1", 3, 10, Move({0,0}, {1,0}), "XO/OX", {{1, Move({0,0}, {1,0}).pack(), ME, 6, 4, 1.5f, 0.25f},
+                                                                     {2, Move({1,1}, {0,1}).pack(), NONE, 2, 1, 2.f, 0.5f}}};
+        writer.push(snapshot);
+    }
+    ifstream in(path);
+    string line;
+    assert(getline(in, line));
+    assert(line == "{\"game\":\"42-1\",\"turn\":3,\"plays\":10,\"move\":\"a1b1\",\"grid\":\"XO/OX\",\"nodes\":"
+                   "[[1,\"a1b1\",6,4,1.5,0.25,1],[2,\"b2a2\",2,1,2,0.5,0]]}");
+    assert(!getline(in, line));
+
+    // The games sharing a trace are told apart
+    assert(TraceWriter::newGame() != TraceWriter::newGame());
+    remove(path.c_str());
+}
+
+
+void testStatsCache()
+{
+    string path = "test_stats.bin";
+    remove(path.c_str());
+    {
+        StatsCache cache(path, 1 << 16);
+        assert(cache.isOpen());
+        vector<thread> writers;
+        for (int i = 0; i < 4; i++)
+        {
+            writers.emplace_back([&cache]()
+            {
+                for (int j = 0; j < 1000; j++)
+                {
+                    cache.add(42, 2, 1);
+                }
+            });
+        }
+        for (thread& writer : writers)
+        {
+            writer.join();
+        }
+    }
+    // A second mapping, as another process would see the file
+    StatsCache cache(path, 0);
+    uint32_t visits, wins;
+    assert(cache.probe(42, visits, wins) && visits == 8000 && wins == 4000);
+    assert(!cache.probe(43, visits, wins));
+
+    // The children of the root, as seen by a search of the next game
+    SearchConfig config(MCTS);
+    config.statsCache = path;
+    Grid grid = GameRecord::startGrid(6);
+    AI ai(grid, config);
+    Move move = ai.play();
+    ai.saveStats();
+    assert(StatsCache::shared(path, 0)->probe(grid.hash(ME) ^ Zobrist::move(move, ME), visits, wins) && visits > 0);
+    remove(path.c_str());
+}
+
+
+void testIsa()
+{
+    Grid grid = BuildGrid("XOXO-XOX"
+                          "OXOXOXO-"
+                          "XO-OXOXO"
+                          "OXOXOX-X"
+                          "X-XOXOXO"
+                          "OXOX-XOX"
+                          "XOXOXOXO"
+                          "O-OXOXOX");
+    assert(IsaSupported(ISA_SCALAR) && IsaSupported(BestIsa()));
+    bufferPossibleMoves_t moves;
+    assert(SetIsa(ISA_SCALAR));
+    int count = grid.getAllPossibleMoves(ME, moves);
+    int eval = evaluate(grid);
+    for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+    {
+        if (SetIsa((Isa)isa))
+        {
+            assert(KERNELS.isa == isa && KERNELS.movegenIsa == isa && KERNELS.evaluateIsa == isa);
+            assert(grid.getAllPossibleMoves(ME, moves) == count);
+            assert(evaluate(grid) == eval);
+        }
+    }
+    KERNELS = FastestKernels();
+    assert(KERNELS.isa == BestIsa() && IsaSupported(KERNELS.movegenIsa) && IsaSupported(KERNELS.evaluateIsa));
+}
+
+
+void testPlayoutPolicy()
+{
+    PlayoutPolicy policy;
+    policy.configure(PLAYOUT_NST, 0.1f, 0.f);
+    bufferPossibleMoves_t moves;
+    moves[0] = Move({0,0}, {1,0});
+    moves[1] = Move({0,0}, {0,1});
+    for (int i = 0; i < 100; i++)
+    {
+        policy.update(ME, 0, moves[0].pack(), true);
+        policy.update(ME, 0, moves[1].pack(), false);
+    }
+    int first = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        first += policy.sample(ME, 0, moves, 2) == 0;
+    }
+    assert(first > 950);
+    // The other player has learned nothing
+    first = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        first += policy.sample(ENEMY, 0, moves, 2) == 0;
+    }
+    assert(first > 400 && first < 600);
+    policy.decay(0.f);
+    first = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        first += policy.sample(ME, 0, moves, 2) == 0;
+    }
+    assert(first > 400 && first < 600);
+    // The root has no NST context: its replies do not alias those of h7h8, packed as 223
+    uint8_t h7h8 = Move({7,6}, {7,7}).pack();
+    assert(h7h8 == 223);
+    for (int i = 0; i < 100; i++)
+    {
+        policy.update(ME, NO_PREVIOUS_MOVE, moves[0].pack(), true);
+        policy.update(ME, NO_PREVIOUS_MOVE, moves[1].pack(), false);
+        policy.update(ME, h7h8, moves[0].pack(), false);
+        policy.update(ME, h7h8, moves[1].pack(), true);
+    }
+    int afterRoot = 0;
+    int afterH7h8 = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        afterRoot += policy.sample(ME, NO_PREVIOUS_MOVE, moves, 2) == 0;
+        afterH7h8 += policy.sample(ME, h7h8, moves, 2) == 0;
+    }
+    assert(afterRoot > 400 && afterRoot < 600 && afterH7h8 < 50);
+
+    SearchConfig config(MCTS);
+    config.playoutPolicy = PLAYOUT_NST;
+    Grid grid = GameRecord::startGrid(6);
+    AI ai(grid, config);
+    ai.play();
+    ai.play();
+    assert(ai.stats().visits > 0);
+}
+
+
+void testRolloutState()
+{
+    for (int game = 0; game < 20; game++)
+    {
+        RolloutState state(GameRecord::startGrid(game % 2 == 0 ? 8 : 5));
+        Player player = ME;
+        while (state.count(player) > 0)
+        {
+            for (Player side : {ME, ENEMY})
+            {
+                bufferPossibleMoves_t expected;
+                bufferPossibleMoves_t actual;
+                int count = state.grid().getAllPossibleMoves(side, expected);
+                assert(state.moves(side, actual) == count);
+                set<int> expectedSet;
+                set<int> actualSet;
+                for (int i = 0; i < count; i++)
+                {
+                    expectedSet.insert(expected[i].pack());
+                    actualSet.insert(actual[i].pack());
+                }
+                assert(expectedSet == actualSet);
+            }
+            state.play(state.sample(player, Random::Bits()));
+            player = player == ME ? ENEMY : ME;
+        }
+        bufferPossibleMoves_t moves;
+        assert(state.grid().getAllPossibleMoves(player, moves) == 0);
+    }
+}
+
+
+void testRandom()
+{
+    array<int, 7> counts = {};
+    for (int i = 0; i < 70000; i++)
+    {
+        counts[Random::Rand(7)]++;
+    }
+    for (int count : counts)
+    {
+        assert(count > 9000 && count < 11000);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        float uniform = Random::Uniform();
+        assert(uniform >= 0.f && uniform < 1.f);
+    }
+
+    // Same seed, same draws, in this thread and in another one
+    array<uint32_t, 16> first, second;
+    Random::Seed(7);
+    Random::Fill(first.data(), first.size());
+    int rand = Random::Rand(1000);
+    thread([&]()
+    {
+        Random::Seed(7);
+        Random::Fill(second.data(), second.size());
+        assert(Random::Rand(1000) == rand);
+    }).join();
+    assert(first == second);
+
+    // A seeded search with a fixed number of loops is reproducible
+    SearchConfig config(MCTS);
+    config.seed = 42;
+    config.loops = 2000;
+    Grid grid = GameRecord::startGrid(6);
+    AI ai1(grid, config);
+    AI ai2(grid, config);
+    Move move = ai1.play();
+    assert(ai2.play() == move);
+    assert(ai1.stats().value == ai2.stats().value);
+    Random::Init();
+}
+
+
+void testLeafPlayouts()
+{
+    // A single loop expands the root and plays out every child, on the workers
+    SearchConfig config(MCTS);
+    config.loops = 1;
+    config.leafPlayouts = 2;
+    config.threads = 2;
+    Grid grid = GameRecord::startGrid(6);
+    AI ai(grid, config);
+    Move move = ai.play();
+    vector<RootStat> stats = ai.rootStats();
+    bufferPossibleMoves_t moves;
+    assert((int)stats.size() == grid.getAllPossibleMoves(ME, moves));
+    for (const RootStat& stat : stats)
+    {
+        assert(stat.plays == 2 || (stat.proven != NONE && stat.plays == 1));
+    }
+    assert(ai.stats().visits == 2 * (int)stats.size());
+    assert(find(moves.begin(), moves.begin() + stats.size(), move) != moves.begin() + stats.size());
+
+    // Later batches run on the same workers, and the policy learns from them
+    config.loops = 5000;
+    config.playoutPolicy = PLAYOUT_MAST;
+    AI ai2(grid, config);
+    ai2.play();
+    assert(ai2.stats().visits >= 5000);
+}
+
+
+void testSequentialHalving()
+{
+    SearchConfig config(MCTS);
+    assert(config.parse("--rootPolicy=halving") && config.get("rootPolicy") == "halving");
+    assert(!config.parse("--rootPolicy=halfing") && config.rootPolicy == ROOT_HALVING);
+    config.loops = 3000;
+    config.seed = 42;
+    Grid grid = GameRecord::startGrid(6);
+    AI ai(grid, config);
+    Move move = ai.play();
+    // Only the odd loop of the last round is not shared
+    assert(ai.stats().visits + 1 >= 3000);
+    // The last survivor got every round, as many plays as the other finalist
+    vector<RootStat> stats = ai.rootStats();
+    const RootStat* chosen = nullptr;
+    int mostPlays = 0;
+    for (const RootStat& stat : stats)
+    {
+        if (stat.move == move)
+        {
+            chosen = &stat;
+        }
+        mostPlays = max(mostPlays, stat.plays);
+    }
+    assert(chosen != nullptr && chosen->plays == mostPlays);
+
+    // A single move needs no rounds
+    Grid single(8);
+    single.set({0,0}, ME);
+    single.set({1,0}, ENEMY);
+    single.set({7,7}, ENEMY);
+    single.set({7,6}, ENEMY);
+    AI forced(single, config);
+    assert(forced.play() == Move({0,0}, {1,0}));
+
+    // Rounds on the time as well, with the children played out in batches
+    config.loops = 0;
+    config.leafPlayouts = 1;
+    AI timed(grid, config);
+    Move timedMove = timed.play(chrono::high_resolution_clock::now() + chrono::milliseconds(50));
+    bufferPossibleMoves_t moves;
+    int count = grid.getAllPossibleMoves(ME, moves);
+    assert(find(moves.begin(), moves.begin() + count, timedMove) != moves.begin() + count);
+    Random::Init();
+}
+
 
 int main()
 {
@@ -147,7 +749,27 @@ int main()
     // testGridGetAllPossibleMoves();
     // testMcts2();
 
+    testAlphaBeta();
+    testLazySmp();
+    testMoveOrdering();
+    testMovePrior();
+    testMovePacking();
+    testGameRecords();
+    testSearchConfig();
+    testMctsSolver();
     testMcts();
+    testMctsMemoryLimit();
+    testServer();
+    testDistributed();
+    testTablebase();
+    testTrace();
+    testStatsCache();
+    testIsa();
+    testPlayoutPolicy();
+    testRolloutState();
+    testRandom();
+    testLeafPlayouts();
+    testSequentialHalving();
 
     DBG("All test passed");
 }
@@ -0,0 +1,235 @@
+// Summarise the tree snapshots written with the trace search parameter.
+// Usage: traceview <trace> [game [turn]]
+// Without a turn, prints one line per turn, grouped by game, of every game or of the given one:
+//   game turn plays move children visits% average margin diagnosis
+// where visits% and average are those of the chosen move, and margin is its
+// average minus the best other average. Diagnoses:
+//   few-visits  the chosen move got less than MIN_VISITS playouts: too few iterations
+//   unstable    the chosen move is not the most visited one: the search had not converged
+//   flat        all root averages are within FLAT_SPREAD: the playouts do not tell the moves apart
+// With a game and a turn, prints the root moves of that turn by visits, with their best replies.
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+const int MIN_VISITS = 100;
+const double FLAT_SPREAD = 0.05;
+
+
+struct ViewNode
+{
+    int depth;
+    string move;
+    int plays;
+    int score;
+    double uct;
+    double prior;
+    int proven;
+
+    double average() const
+    {
+        return plays > 0 ? (double)score / plays : 0.;
+    }
+};
+
+
+struct ViewSnapshot
+{
+    string game;
+    int turn;
+    int plays;
+    string move;
+    string grid;
+    vector<ViewNode> nodes;
+};
+
+
+// Only reads what TraceWriter writes
+bool ParseSnapshot(const string& line, ViewSnapshot& snapshot)
+{
+    auto field = [&](const string& name) -> size_t
+    {
+        size_t position = line.find("\"" + name + "\":");
+        return position == string::npos ? string::npos : position + name.size() + 3;
+    };
+    auto text = [&](size_t position) -> string
+    {
+        size_t end = line.find('"', position + 1);
+        return line.substr(position + 1, end - position - 1);
+    };
+    size_t turn = field("turn"), plays = field("plays"), move = field("move"), grid = field("grid"), nodes = field("nodes");
+    if (turn == string::npos || plays == string::npos || move == string::npos || grid == string::npos || nodes == string::npos)
+    {
+        return false;
+    }
+    // Traces written before game ids all belong to the game ""
+    size_t game = field("game");
+    snapshot.game = game == string::npos ? "" : text(game);
+    snapshot.turn = stoi(line.substr(turn));
+    snapshot.plays = stoi(line.substr(plays));
+    snapshot.move = text(move);
+    snapshot.grid = text(grid);
+    snapshot.nodes.clear();
+    for (size_t position = line.find('[', nodes + 1); position != string::npos; position = line.find('[', position + 1))
+    {
+        string values = line.substr(position + 1, line.find(']', position) - position - 1);
+        replace(values.begin(), values.end(), ',', ' ');
+        replace(values.begin(), values.end(), '"', ' ');
+        istringstream in(values);
+        ViewNode node;
+        if (in >> node.depth >> node.move >> node.plays >> node.score >> node.uct >> node.prior >> node.proven)
+        {
+            snapshot.nodes.push_back(node);
+        }
+    }
+    return true;
+}
+
+
+void Summarise(const ViewSnapshot& snapshot)
+{
+    const ViewNode* chosen = nullptr;
+    const ViewNode* mostVisited = nullptr;
+    double bestOther = -1.;
+    double lowest = 2., highest = -1.;
+    int children = 0;
+    for (const ViewNode& node : snapshot.nodes)
+    {
+        if (node.depth != 1)
+        {
+            continue;
+        }
+        children++;
+        if (node.move == snapshot.move)
+        {
+            chosen = &node;
+        }
+        else if (node.plays > 0)
+        {
+            bestOther = max(bestOther, node.average());
+        }
+        if (mostVisited == nullptr || node.plays > mostVisited->plays)
+        {
+            mostVisited = &node;
+        }
+        if (node.plays > 0)
+        {
+            lowest = min(lowest, node.average());
+            highest = max(highest, node.average());
+        }
+    }
+    cout << snapshot.game << " " << snapshot.turn << " " << snapshot.plays << " " << snapshot.move << " " << children;
+    if (chosen == nullptr)
+    {
+        cout << endl;
+        return;
+    }
+    cout << " " << 100. * chosen->plays / max(1, snapshot.plays) << "% " << chosen->average() << " "
+         << (bestOther >= 0. ? chosen->average() - bestOther : 0.);
+    if (chosen->proven != NONE)
+        cout << " proven";
+    if (chosen->proven == NONE && chosen->plays < MIN_VISITS)
+        cout << " few-visits";
+    if (mostVisited->plays > chosen->plays && chosen->proven == NONE)
+        cout << " unstable";
+    if (children > 1 && highest - lowest < FLAT_SPREAD)
+        cout << " flat";
+    cout << endl;
+}
+
+
+void Detail(const ViewSnapshot& snapshot)
+{
+    cout << "game " << snapshot.game << ", turn " << snapshot.turn << ", " << snapshot.plays << " playouts, played " << snapshot.move << endl;
+    string grid = snapshot.grid;
+    replace(grid.begin(), grid.end(), '/', '\n');
+    cout << grid << endl;
+    // Root moves with the index of their subtree
+    vector<pair<size_t, size_t>> roots;
+    for (size_t i = 0; i < snapshot.nodes.size(); i++)
+    {
+        if (snapshot.nodes[i].depth == 1)
+        {
+            roots.push_back({i, i + 1});
+        }
+        else if (!roots.empty())
+        {
+            roots.back().second = i + 1;
+        }
+    }
+    sort(roots.begin(), roots.end(), [&](const pair<size_t, size_t>& a, const pair<size_t, size_t>& b)
+        { return snapshot.nodes[a.first].plays > snapshot.nodes[b.first].plays; });
+    for (const pair<size_t, size_t>& root : roots)
+    {
+        const ViewNode& node = snapshot.nodes[root.first];
+        cout << node.move << " plays " << node.plays << " average " << node.average() << " uct " << node.uct
+             << " prior " << node.prior << (node.proven != NONE ? node.proven == ME ? " won" : " lost" : "");
+        const ViewNode* reply = nullptr;
+        for (size_t i = root.first + 1; i < root.second; i++)
+        {
+            if (snapshot.nodes[i].depth == 2 && (reply == nullptr || snapshot.nodes[i].plays > reply->plays))
+            {
+                reply = &snapshot.nodes[i];
+            }
+        }
+        if (reply != nullptr)
+        {
+            cout << ", reply " << reply->move << " plays " << reply->plays << " average " << reply->average();
+        }
+        cout << endl;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        DBG("usage: traceview <trace> [game [turn]]");
+        return 1;
+    }
+    ifstream in(argv[1]);
+    if (!in)
+    {
+        DBG("cannot read " << argv[1]);
+        return 1;
+    }
+    bool allGames = argc < 3;
+    string game = allGames ? "" : argv[2];
+    int turn = argc > 3 ? stoi(argv[3]) : 0;
+    // The games of a server are interleaved in the trace: group them in order of appearance
+    vector<string> games;
+    map<string, vector<ViewSnapshot>> snapshots;
+    string line;
+    ViewSnapshot snapshot;
+    while (getline(in, line))
+    {
+        if (!ParseSnapshot(line, snapshot))
+        {
+            DBG("bad line " << line.substr(0, 40));
+        }
+        else if (allGames || snapshot.game == game)
+        {
+            if (snapshots.find(snapshot.game) == snapshots.end())
+            {
+                games.push_back(snapshot.game);
+            }
+            snapshots[snapshot.game].push_back(snapshot);
+        }
+    }
+    for (const string& id : games)
+    {
+        for (const ViewSnapshot& view : snapshots[id])
+        {
+            if (turn == 0)
+            {
+                Summarise(view);
+            }
+            else if (view.turn == turn)
+            {
+                Detail(view);
+            }
+        }
+    }
+}
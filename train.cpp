@@ -0,0 +1,155 @@
+// Fit MOVE_PRIOR_WEIGHTS on recorded games (see selfplay.cpp): the model
+// learns to predict the moves that were played.
+// Usage: train <records> [epochs]    (prints the weights to paste in clobber.cpp)
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+struct Sample
+{
+    int count;
+    int chosen;
+    bufferFeatures_t features;
+};
+
+
+// Every position is seen from the player to move. A game with a move that is not
+// legal is corrupted from there on, and is skipped as a whole.
+void LoadSamples(GameRecordReader& reader, vector<Sample>& samples)
+{
+    GameView game;
+    int skipped = 0;
+    while (reader.next(game))
+    {
+        Grid grid = GameRecord::startGrid(game.header->boardSize);
+        Player mover = ME;
+        bufferPossibleMoves_t moves;
+        vector<Sample> gameSamples;
+        for (int i = 0; i < game.moveCount(); i++)
+        {
+            Move played = game.move(i);
+            Sample sample;
+            sample.count = grid.getAllPossibleMoves(mover, moves);
+            sample.chosen = find(moves.begin(), moves.begin() + sample.count, played) - moves.begin();
+            if (sample.chosen == sample.count)
+            {
+                gameSamples.clear();
+                skipped++;
+                break;
+            }
+            MovePrior::features(grid, mover, moves, sample.count, sample.features);
+            gameSamples.push_back(sample);
+            grid.play(played);
+            mover = mover == ME ? ENEMY : ME;
+        }
+        samples.insert(samples.end(), gameSamples.begin(), gameSamples.end());
+    }
+    if (skipped > 0)
+    {
+        DBG(skipped << " games with an illegal move skipped");
+    }
+}
+
+
+// Mean log-likelihood of the chosen moves, and its gradient
+double LogLikelihood(const vector<Sample>& samples, const priorWeights_t& weights, priorWeights_t& gradient)
+{
+    gradient.fill(0.f);
+    double total = 0.;
+    for (const Sample& sample : samples)
+    {
+        bufferPriors_t scores = {};
+        for (int f = 0; f < PRIOR_FEATURES; f++)
+        {
+            for (int i = 0; i < sample.count; i++)
+            {
+                scores[i] += weights[f] * sample.features[f][i];
+            }
+        }
+        float maxScore = *max_element(scores.begin(), scores.begin() + sample.count);
+        double sum = 0.;
+        for (int i = 0; i < sample.count; i++)
+        {
+            scores[i] = expf(scores[i] - maxScore);
+            sum += scores[i];
+        }
+        total += log(scores[sample.chosen] / sum);
+        for (int f = 0; f < PRIOR_FEATURES; f++)
+        {
+            double expected = 0.;
+            for (int i = 0; i < sample.count; i++)
+            {
+                expected += scores[i] / sum * sample.features[f][i];
+            }
+            gradient[f] += sample.features[f][sample.chosen] - expected;
+        }
+    }
+    for (int f = 0; f < PRIOR_FEATURES; f++)
+    {
+        gradient[f] /= samples.size();
+    }
+    return total / samples.size();
+}
+
+
+priorWeights_t Fit(const vector<Sample>& samples, int epochs)
+{
+    const float LEARNING_RATE = 0.1f;
+    const float L2 = 0.001f;
+    priorWeights_t weights = {};
+    priorWeights_t gradient;
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        double logLikelihood = LogLikelihood(samples, weights, gradient);
+        for (int f = 0; f < PRIOR_FEATURES; f++)
+        {
+            weights[f] += LEARNING_RATE * (gradient[f] - L2 * weights[f]);
+        }
+        if (epoch % 50 == 0)
+        {
+            DBG("epoch " << epoch << ": log-likelihood " << logLikelihood);
+        }
+    }
+    double logLikelihood = LogLikelihood(samples, weights, gradient);
+    double uniform = 0.;
+    for (const Sample& sample : samples)
+    {
+        uniform -= log(sample.count);
+    }
+    DBG("final log-likelihood " << logLikelihood << " (uniform " << uniform / samples.size() << ")");
+    return weights;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        DBG("usage: train <records> [epochs]");
+        return 1;
+    }
+    int epochs = argc > 2 ? stoi(argv[2]) : 500;
+
+    GameRecordReader reader(argv[1]);
+    if (!reader.isOpen())
+    {
+        DBG("cannot read " << argv[1]);
+        return 1;
+    }
+    vector<Sample> samples;
+    LoadSamples(reader, samples);
+    DBG(samples.size() << " samples");
+    if (samples.empty())
+    {
+        return 1;
+    }
+    priorWeights_t weights = Fit(samples, epochs);
+
+    cout << "const priorWeights_t MOVE_PRIOR_WEIGHTS = {";
+    for (int f = 0; f < PRIOR_FEATURES; f++)
+    {
+        cout << weights[f] << "f" << (f < PRIOR_FEATURES - 1 ? ", " : "};");
+    }
+    cout << endl;
+}
@@ -0,0 +1,163 @@
+// SPSA tuning of numeric search parameters by parallel self-play.
+// Usage: tune --param=key:step [--param=key:step]... [--iterations=N] [--games=N] [--threads=N] [--key=value]...
+// Each iteration plays a match between theta + c*step*delta and theta - c*step*delta,
+// delta being a random +/-1 per parameter, then moves theta toward the winner.
+// Both sides use the budget of the base parameters (--timeout or --loops), so run it
+// once per time budget. Prints the tuned parameters as a configuration file.
+#define LOCAL
+
+#include "clobber.cpp"
+
+
+struct TunedParam
+{
+    string key;
+    double value;
+    double step;
+};
+
+
+// Return the winner, ME being the first player
+Player PlayMatchGame(const SearchConfig& first, const SearchConfig& second)
+{
+    Grid grid = GameRecord::startGrid(8);
+    Player mover = ME;
+    bufferPossibleMoves_t moves;
+    while (true)
+    {
+        Grid view = mover == ME ? grid : grid.swapped();
+        if (view.getAllPossibleMoves(ME, moves) == 0)
+        {
+            return mover == ME ? ENEMY : ME;
+        }
+        const SearchConfig& config = mover == ME ? first : second;
+        AI ai(view, config);
+        grid.play(ai.play(chrono::high_resolution_clock::now() + chrono::milliseconds(config.timeout)));
+        mover = mover == ME ? ENEMY : ME;
+    }
+}
+
+
+// Score of plus against minus in [-1, 1], sides swapping colours every game
+double PlayMatch(const SearchConfig& plus, const SearchConfig& minus, int games, int threads)
+{
+    atomic<int> nextGame(0);
+    atomic<int> plusWins(0);
+    vector<thread> workers;
+    for (int worker = 0; worker < threads; worker++)
+    {
+        workers.emplace_back([&]()
+        {
+            int game;
+            while ((game = nextGame++) < games)
+            {
+                bool plusFirst = game % 2 == 0;
+                Player winner = plusFirst ? PlayMatchGame(plus, minus) : PlayMatchGame(minus, plus);
+                if ((winner == ME) == plusFirst)
+                {
+                    plusWins++;
+                }
+            }
+        });
+    }
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+    return 2. * plusWins / games - 1.;
+}
+
+
+void Apply(SearchConfig& config, const vector<TunedParam>& params, const vector<double>& values)
+{
+    for (size_t i = 0; i < params.size(); i++)
+    {
+        // Integer parameters are printed without a decimal point
+        bool integer = config.get(params[i].key).find('.') == string::npos;
+        config.set(params[i].key, integer ? to_string(lround(values[i])) : to_string(values[i]));
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    Random::Init();
+
+    const double A = 0.602;     // usual SPSA decay of the update gain
+    const double GAMMA = 0.101; // usual SPSA decay of the perturbation
+    SearchConfig base;
+    vector<TunedParam> params;
+    int iterations = 100;
+    int games = 32;
+    int threads = max(1u, thread::hardware_concurrency());
+    double gain = 1.;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        size_t equal = argument.find('=');
+        string option = argument.substr(0, equal);
+        string value = equal == string::npos ? "" : argument.substr(equal + 1);
+        if (option == "--param")
+            params.push_back({value.substr(0, value.find(':')), 0., stod(value.substr(value.find(':') + 1))});
+        else if (option == "--iterations")
+            iterations = stoi(value);
+        else if (option == "--games")
+            games = max(2, stoi(value));
+        else if (option == "--threads")
+            threads = max(1, stoi(value));
+        else if (option == "--gain")
+            gain = stod(value);
+        else if (!base.parse(argument))
+            DBG("unknown argument " << argument);
+    }
+    if (params.empty())
+    {
+        DBG("usage: tune --param=key:step [--param=key:step]... [--iterations=N] [--games=N] [--threads=N] [--gain=G] [--key=value]...");
+        return 1;
+    }
+    for (TunedParam& param : params)
+    {
+        if (base.get(param.key).empty())
+        {
+            DBG("unknown search parameter " << param.key);
+            return 1;
+        }
+        param.value = stod(base.get(param.key));
+    }
+
+    for (int k = 0; k < iterations; k++)
+    {
+        double ak = gain / pow(k + 1, A);
+        double ck = 1. / pow(k + 1, GAMMA);
+        vector<double> delta(params.size());
+        vector<double> plusValues(params.size());
+        vector<double> minusValues(params.size());
+        for (size_t i = 0; i < params.size(); i++)
+        {
+            delta[i] = Random::Rand(2) == 0 ? -1. : 1.;
+            plusValues[i] = max(0., params[i].value + ck * params[i].step * delta[i]);
+            minusValues[i] = max(0., params[i].value - ck * params[i].step * delta[i]);
+        }
+        SearchConfig plus = base;
+        SearchConfig minus = base;
+        Apply(plus, params, plusValues);
+        Apply(minus, params, minusValues);
+        double score = PlayMatch(plus, minus, games, threads);
+
+        string progress = "iteration " + to_string(k + 1) + ": score " + to_string(score);
+        for (size_t i = 0; i < params.size(); i++)
+        {
+            params[i].value = max(0., params[i].value + ak * params[i].step * delta[i] * score);
+            progress += " " + params[i].key + "=" + to_string(params[i].value);
+        }
+        DBG(progress);
+    }
+
+    vector<double> values;
+    for (const TunedParam& param : params)
+    {
+        values.push_back(param.value);
+    }
+    Apply(base, params, values);
+    cout << base.toString();
+}